@@ -0,0 +1,13 @@
+#version 100
+precision mediump float;
+
+varying vec3 v_normal;
+varying vec3 v_color0;
+varying vec2 v_texcoord0;
+
+uniform sampler2D s_spriteTexture;
+
+void main() {
+	float coverage = texture2D(s_spriteTexture, v_texcoord0).a;
+    gl_FragColor = vec4(v_color0, coverage);
+}
\ No newline at end of file
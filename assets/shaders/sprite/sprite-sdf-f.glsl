@@ -0,0 +1,16 @@
+#version 100
+precision mediump float;
+
+varying vec3 v_normal;
+varying vec3 v_color0;
+varying vec2 v_texcoord0;
+
+uniform sampler2D s_spriteTexture;
+
+void main() {
+	// 0.5 is the outline, v_normal.x is how far the field moves in one
+	// screen pixel at the size the glyph is drawn at
+	float distance = texture2D(s_spriteTexture, v_texcoord0).a;
+	float coverage = smoothstep(0.5 - v_normal.x, 0.5 + v_normal.x, distance);
+    gl_FragColor = vec4(v_color0, coverage);
+}
\ No newline at end of file
@@ -7,15 +7,17 @@ attribute vec3 a_color0;
 attribute vec2 a_texcoord0;
 
 uniform mat4 u_mvp;
+uniform vec2 u_translation;
+uniform vec3 u_color;
 
 varying vec3 v_normal;
 varying vec3 v_color0;
 varying vec2 v_texcoord0;
 
 void main() {
-    vec4 position = u_mvp * vec4(a_position, 1.0);
+    vec4 position = u_mvp * vec4(a_position + vec3(u_translation, 0.0), 1.0);
     gl_Position = position;
     v_normal = a_normal;
-    v_color0 = a_color0;
+    v_color0 = a_color0 * u_color;
     v_texcoord0 = a_texcoord0;
 }
\ No newline at end of file
@@ -0,0 +1,87 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+struct AtlasRect {
+	uint16_t x = 0, y = 0, w = 0, h = 0;
+};
+
+enum class AtlasPackerType {
+	Skyline, // Bottom-left skyline, fast and good for glyphs of similar height
+	MaxRects // Best short side fit over free rectangles, tighter for mixed sizes
+};
+
+// Hands out non-overlapping rectangles of a width * height area
+struct AtlasPacker {
+	AtlasPacker(uint16_t width, uint16_t height);
+	virtual ~AtlasPacker() {}
+
+	// Finds room for a w * h rectangle, returns false once nothing fits
+	virtual bool Pack(uint16_t w, uint16_t h, AtlasRect& out) = 0;
+	virtual void Reset() = 0;
+
+	// Marks a rectangle as taken, for restoring a previously packed atlas
+	virtual void Reserve(const AtlasRect& rect) = 0;
+
+	// Gives a rectangle handed out before back, it merges with free
+	// neighbours that share a whole edge with it
+	virtual void Free(const AtlasRect& rect) = 0;
+
+	// Fraction of the area handed out so far
+	float Occupancy() const;
+
+	uint16_t width;
+	uint16_t height;
+	size_t usedArea;
+};
+
+struct SkylinePacker : AtlasPacker {
+	SkylinePacker(uint16_t width, uint16_t height);
+
+	bool Pack(uint16_t w, uint16_t h, AtlasRect& out) override;
+	void Reset() override;
+	void Reserve(const AtlasRect& rect) override;
+	void Free(const AtlasRect& rect) override;
+
+	// Takes w * h out of the freed rectangles, returns false when none fits
+	bool PackFreed(uint16_t w, uint16_t h, AtlasRect& out);
+
+	// Merges neighbouring nodes at the same height
+	void MergeNodes();
+
+	// Returns the height a w wide rectangle would sit at when its left
+	// edge is on node index, or -1 when it doesn't fit there
+	int Fit(size_t index, int w, int h) const;
+
+	// Top edges of the packed area from left to right
+	struct Node {
+		int x, y, w;
+	};
+
+	std::vector<Node> skyline;
+
+	// Holes under the skyline left by Free, tried before it
+	std::vector<AtlasRect> freed;
+};
+
+struct MaxRectsPacker : AtlasPacker {
+	MaxRectsPacker(uint16_t width, uint16_t height);
+
+	bool Pack(uint16_t w, uint16_t h, AtlasRect& out) override;
+	void Reset() override;
+	void Reserve(const AtlasRect& rect) override;
+	void Free(const AtlasRect& rect) override;
+
+	struct Rect {
+		int x, y, w, h;
+	};
+
+	void SplitFreeRects(const Rect& used);
+	void PruneFreeRects();
+
+	std::vector<Rect> freeRects;
+};
+
+AtlasPacker* CreateAtlasPacker(AtlasPackerType type, uint16_t width, uint16_t height);
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+// Turns glyph coverage into a signed distance field. 0.5 sits on the
+// outline and the value moves by 0.5 / spread per texel, so the field
+// reaches 0 or 1 spread texels away from the edge.
+struct DistanceFieldGenerator {
+	// Reads a w * h block of coverage the same way GlyphAtlas::WriteCoverage
+	// does and writes (w + 2 * spread) * (h + 2 * spread) bytes to out, the
+	// extra border leaves room for the field outside the outline
+	void Generate(const uint8_t* src, int w, int h, ptrdiff_t srcPitch, size_t srcStride, int spread, uint8_t* out);
+
+	// Squared distances to the nearest texel where the seed is set
+	void Transform(const std::vector<uint8_t>& seed, int w, int h, std::vector<float>& out);
+
+	// Scratch space, kept around so glyphs don't allocate once it has grown
+	std::vector<uint8_t> inside;
+	std::vector<uint8_t> outside;
+	std::vector<float> distanceInside;
+	std::vector<float> distanceOutside;
+	std::vector<float> f;
+	std::vector<float> d;
+	std::vector<float> z;
+	std::vector<int> v;
+};
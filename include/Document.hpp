@@ -0,0 +1,32 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include "Utility.hpp"
+
+// A read-only UTF-8 file too big to lay out whole, like a log. The file
+// is memory mapped and its lines are indexed a chunk at a time, so the
+// top of it can be shown while the rest is still being scanned.
+struct Document {
+	Document();
+	~Document();
+
+	bool Open(const char* path);
+	void Close();
+
+	// Scans up to maxBytes more of the file for line breaks, returns true
+	// once all of it has been indexed
+	bool IndexLines(size_t maxBytes);
+	bool Indexed() const;
+
+	// Lines found so far, the last one may still grow while indexing
+	size_t NumLines() const;
+
+	// Bytes of a line without its line break
+	const char* GetLine(size_t index, size_t& length) const;
+
+	Utility::MappedFile file;
+	std::vector<size_t> lineStarts; // Byte offset of every line found so far
+	size_t indexedBytes;
+};
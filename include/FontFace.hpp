@@ -0,0 +1,44 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include "FontSet.hpp"
+#include "GlyphRasterizer.hpp"
+#include "FontMetrics.hpp"
+#include "TextShaper.hpp"
+
+struct FontFaceDesc {
+	const void* fontBuffer = nullptr;
+	size_t fontBufferSize = 0;
+
+	// Tried in order for codepoints fontBuffer doesn't have
+	const FontSource* fallbackFonts = nullptr;
+	size_t numFallbackFonts = 0;
+
+	size_t fontSize = 20;
+	FontStyle style = FontStyle::Regular;
+
+	// Glyphs are kept at this many horizontal offsets within a pixel, up
+	// to MaxSubpixelPositions, and drawn from the one nearest to the pen.
+	// 1 keeps every glyph on a whole pixel. Distance fields always use 1,
+	// they're resampled anyway.
+	uint8_t subpixelPositions = 1;
+};
+
+// A font chain at one size and style. A TextRenderer can have several,
+// their glyphs share its atlas and carry the face's id in their keys.
+struct FontFace {
+	FontFace(const FontFaceDesc& desc, uint8_t id, uint16_t spread);
+	~FontFace();
+
+	uint8_t id;
+	size_t fontSize;
+	FontStyle style;
+	uint8_t subpixelPositions;
+
+	FontSet fonts; // Kept so worker threads can open their own fonts
+	GlyphRasterizer rasterizer;
+	FontMetrics metrics; // Line height and kerning, read from the rasterizer's faces
+	TextShaper shaper;
+	AsyncGlyphRasterizer* asyncRasterizer; // Null unless the renderer rasterizes asynchronously
+};
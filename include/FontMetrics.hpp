@@ -0,0 +1,70 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include <unordered_map>
+#include <ft2build.h>
+#include FT_FREETYPE_H
+#include "FontSet.hpp"
+
+// What layout needs from a font at one size, read from FreeType up front
+// so the layout loop never calls into it. Latin-1 advances and kerning
+// pairs sit in flat tables. Anything outside Latin-1 is asked for once
+// and remembered, up to a limit. Advances come from whichever font of the set draws the
+// codepoint, the line metrics from the first. Advances are whole pixels
+// unless built for subpixel positioning.
+struct FontMetrics {
+	FontMetrics();
+
+	// Fills the tables from faces, one per font of the set, which all have
+	// to outlive this. Build and GetAdvance load glyphs into the faces'
+	// glyph slots, so don't call them between loading a glyph and
+	// rendering it.
+	// fractional keeps the unhinted advances as they are instead of
+	// rounding them.
+	void Build(const std::vector<FT_Face>& faces, const FontSet& fonts, int extraAdvance = 0, bool fractional = false);
+
+	// Face that draws c, never null once built with a usable first font
+	FT_Face FindFace(uint32_t c) const;
+
+	// In pixels. Latin-1 is looked up inline, measuring and layout loops
+	// only call out for the rest.
+	float GetAdvance(uint32_t c) {
+		return (c < DenseSize) ? advances[c] : GetExtendedAdvance(c);
+	}
+
+	// Adjustment to the pen between left and right, in whole pixels
+	int GetKerning(uint32_t left, uint32_t right) {
+		if (!hasKerning) {
+			return 0;
+		}
+
+		return (left < DenseSize && right < DenseSize) ? kerning[left * DenseSize + right] : GetExtendedKerning(left, right);
+	}
+
+	float GetExtendedAdvance(uint32_t c);
+	int GetExtendedKerning(uint32_t left, uint32_t right);
+
+	static const size_t DenseSize = 256;
+
+	// Past these the extended caches are emptied, so scrolling through
+	// every script a font has doesn't grow them without end
+	static const size_t MaxExtendedAdvances = 4096;
+	static const size_t MaxExtendedKerning = 16384;
+
+	int ascender; // Above the baseline
+	int descender; // Below the baseline, negative
+	int lineHeight; // Distance between baselines
+	int extraAdvance; // Added to every advance, synthetic bold makes glyphs wider
+	bool fractional;
+
+	FT_Face face; // The first font
+	std::vector<FT_Face> faces;
+	const FontSet* fonts;
+	bool hasKerning;
+	float advances[DenseSize];
+	std::vector<int8_t> kerning; // DenseSize * DenseSize, empty without kerning. Pairs from different fonts don't kern.
+	std::unordered_map<uint32_t, float> extendedAdvances;
+	std::unordered_map<uint64_t, int16_t> extendedKerning;
+};
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+struct FontSource {
+	const void* buffer = nullptr; // Has to outlive everything drawing with it
+	size_t size = 0;
+};
+
+// Fonts to draw with in order of preference, each codepoint comes from
+// the first font that has it. Which font that is gets worked out once
+// per font when it's added, into a table over all of Unicode, so looking
+// it up while drawing is two loads rather than asking every font in turn.
+struct FontSet {
+	FontSet();
+
+	// Appends a font to the chain, returns false when it can't be read
+	// or the chain is full
+	bool Add(const void* buffer, size_t size);
+
+	// Index of the font to draw c with, the first font when none has it
+	uint8_t Find(uint32_t c) const {
+		if (c >= NumCodepoints) {
+			return 0;
+		}
+
+		const uint8_t Font = blocks[(size_t)blockIndex[c >> BlockShift] << BlockShift | (c & BlockMask)];
+		return (Font == NoFont) ? 0 : Font;
+	}
+
+	// True when some font has c
+	bool Covers(uint32_t c) const;
+
+	static const uint32_t NumCodepoints = 0x110000;
+	static const uint32_t BlockShift = 8;
+	static const uint32_t BlockMask = (1u << BlockShift) - 1;
+	static const uint8_t NoFont = 0xFF;
+	static const size_t MaxFonts = 32; // Glyph index keys keep the font in 5 bits
+
+	std::vector<FontSource> fonts;
+
+	// Font of every codepoint, BlockMask + 1 at a time. Blocks no font
+	// has anything in all share block 0.
+	std::vector<uint16_t> blockIndex;
+	std::vector<uint8_t> blocks;
+};
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include "RenderContext.hpp"
+#include "AtlasPacker.hpp"
+
+struct GlyphAtlasDesc {
+	size_t width = 1024; // Size of each page
+	size_t height = 1024;
+	TextureFormat format = TextureFormat::Alpha8;
+	AtlasPackerType packer = AtlasPackerType::Skyline;
+	size_t maxPages = 4; // At most GlyphAtlas::MaxPages
+	size_t memoryBudget = 0; // Bytes of texel storage over all pages, 0 for no limit
+};
+
+// One texture worth of glyphs
+struct GlyphAtlasPage {
+	GlyphAtlasPage(const GlyphAtlasDesc& desc);
+	~GlyphAtlasPage();
+
+	void MarkDirty(const SDL_Rect& rect);
+
+	TextureHandle texture;
+	AtlasPacker* packer;
+	uint8_t* pixels;
+
+	// Regions of pixels that changed since the last Upload, neighbouring
+	// regions get merged so a new row of glyphs stays one upload
+	static const size_t MaxDirtyRects = 8;
+	SDL_Rect dirtyRects[MaxDirtyRects];
+	size_t numDirtyRects;
+};
+
+// CPU side copy of the glyph cache textures. Glyph coverage gets written
+// in here and only the regions that changed are sent to the GPU. Another
+// page is started whenever the existing ones are full, up to maxPages.
+struct GlyphAtlas {
+	GlyphAtlas(const GlyphAtlasDesc& desc);
+	~GlyphAtlas();
+
+	// Reserves a w * h region on some page, returns false when every page
+	// is full and no more may be added
+	bool Allocate(uint16_t w, uint16_t h, AtlasRect& out, uint16_t& page);
+	bool AddPage();
+
+	// Writes a w * h block of 8-bit coverage at x, y. srcPitch is the offset
+	// between rows (negative to flip) and srcStride the offset between texels,
+	// so the alpha channel of a 32-bit surface can be read in place.
+	void WriteCoverage(uint16_t page, uint16_t x, uint16_t y, uint16_t w, uint16_t h, const uint8_t* src, ptrdiff_t srcPitch, size_t srcStride);
+	void Clear(uint16_t page, const AtlasRect& rect);
+
+	// For rendering glyphs in place, rows go up pitch bytes at a time.
+	// Regions written this way have to be marked dirty by hand.
+	uint8_t* GetTexel(uint16_t page, uint16_t x, uint16_t y);
+	void MarkDirty(uint16_t page, const AtlasRect& rect);
+
+	void Upload();
+
+	// Fraction of the area handed out over all pages
+	float Occupancy() const;
+
+	// Layout tracks the pages a string touches in a 32-bit mask
+	static const size_t MaxPages = 32;
+
+	GlyphAtlasDesc desc;
+	std::vector<GlyphAtlasPage*> pages;
+
+	size_t pitch;
+	size_t bytesPerPixel;
+	uint8_t* uploadScratch; // Packs partial-width regions, GLES2 can't upload those with a row stride
+	size_t uploadScratchSize;
+
+	struct UploadStats {
+		size_t bytesUploaded = 0; // Bytes sent by the last Upload
+		size_t numUploads = 0; // glTexSubImage2D calls issued by the last Upload
+		size_t totalBytesUploaded = 0;
+	};
+
+	UploadStats uploadStats;
+};
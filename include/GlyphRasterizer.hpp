@@ -0,0 +1,148 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include <deque>
+#include <unordered_set>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <ft2build.h>
+#include FT_FREETYPE_H
+#include "DistanceField.hpp"
+#include "FontSet.hpp"
+
+// Set on glyph keys that hold a font glyph index instead of a codepoint,
+// for shaped glyphs like ligatures that no codepoint maps to. The font in
+// the FontSet goes above the index. Codepoint keys don't need it, FontSet
+// decides which font draws a codepoint.
+static const uint32_t GlyphIndexBit = 0x80000000;
+static const uint32_t GlyphFontShift = 16;
+static const uint32_t GlyphIndexMask = (1u << GlyphFontShift) - 1;
+
+// Either kind of key keeps the face it's drawn with, the size and style
+// the renderer has the glyph at, in the bits under GlyphIndexBit.
+// Rasterizers ignore it, it only keeps the faces apart in the glyph table.
+static const uint32_t GlyphFaceShift = 23;
+static const uint32_t GlyphFaceMask = 0xFFu << GlyphFaceShift;
+
+// Under the face goes which of the face's subpixel positions the glyph
+// was rasterized at, phase p of n is shifted right by p / n pixels
+static const uint32_t GlyphPhaseShift = 21;
+static const uint32_t GlyphPhaseMask = 3u << GlyphPhaseShift;
+static const uint8_t MaxSubpixelPositions = 4;
+
+// Everything that isn't the codepoint or the font and glyph index
+static const uint32_t GlyphVariantMask = GlyphFaceMask | GlyphPhaseMask;
+
+inline uint32_t MakeGlyphIndexKey(uint8_t font, uint32_t index) {
+	return GlyphIndexBit | ((uint32_t)font << GlyphFontShift) | (index & GlyphIndexMask);
+}
+
+inline uint32_t SetGlyphFace(uint32_t key, uint8_t face) {
+	return (key & ~GlyphFaceMask) | ((uint32_t)face << GlyphFaceShift);
+}
+
+inline uint8_t GetGlyphFace(uint32_t key) {
+	return (uint8_t)((key & GlyphFaceMask) >> GlyphFaceShift);
+}
+
+inline uint32_t SetGlyphPhase(uint32_t key, uint8_t phase) {
+	return (key & ~GlyphPhaseMask) | ((uint32_t)phase << GlyphPhaseShift);
+}
+
+inline uint8_t GetGlyphPhase(uint32_t key) {
+	return (uint8_t)((key & GlyphPhaseMask) >> GlyphPhaseShift);
+}
+
+// Synthesized from the regular outlines, for fonts that don't come with
+// a bold or italic file
+enum class FontStyle {
+	Regular = 0,
+	Bold = 1,
+	Italic = 2,
+	BoldItalic = 3
+};
+
+// One rasterized glyph, ready to be copied into the atlas. Rows are
+// stored bottom-up like the atlas, with the distance field border included.
+struct GlyphBitmap {
+	uint32_t codepoint = 0; // Or a glyph index with GlyphIndexBit set
+	uint16_t w = 0;
+	uint16_t h = 0;
+	uint16_t spread = 0;
+	int16_t bearingX = 0; // Bottom-left corner of the bitmap relative to the pen
+	int16_t bearingY = 0;
+	uint16_t advance = 0; // How far the pen moves on
+	std::vector<uint8_t> pixels;
+};
+
+// Renders glyph outlines with FreeType. Each rasterizer owns its library
+// and faces, so every thread rasterizing glyphs can have its own. With
+// more than one subpixel position, outlines are only hinted vertically
+// so the phases of a glyph all have the same shape.
+struct GlyphRasterizer {
+	GlyphRasterizer(const FontSet& fonts, size_t fontSize, uint16_t spread, FontStyle style = FontStyle::Regular, uint8_t subpixelPositions = 1);
+	~GlyphRasterizer();
+
+	// Loads the outline of c and fills in everything but the pixels of out
+	bool Load(uint32_t c, GlyphBitmap& out);
+
+	// Renders the coverage of the glyph last loaded, without the distance
+	// field border, into dst. The pitch follows FT_Bitmap, negative when
+	// dst is the bottom row and rows go up from there. Texels the outline
+	// doesn't touch are left alone, so dst has to be cleared.
+	void Render(uint8_t* dst, ptrdiff_t pitch);
+
+	// Load and Render into out.pixels, as a distance field when spread is set
+	bool Rasterize(uint32_t c, GlyphBitmap& out);
+
+	// Face the glyph key is drawn with
+	FT_Face FindFace(uint32_t c) const;
+
+	const FontSet& fonts;
+	FT_Library library;
+	std::vector<FT_Face> faces; // One per font in the set, null where it failed to open
+	FT_Face face; // The first font, the line is laid out with its metrics
+	FT_Face loaded; // Holds the glyph last loaded
+	uint16_t spread; // Distance field spread, 0 for plain coverage
+	int descender; // Below the baseline in pixels, negative
+	FontStyle style;
+	FT_Pos emboldenStrength; // How much bold widens outlines and advances, 26.6
+	uint8_t subpixelPositions; // Phases per pixel, 1 when glyphs sit on whole pixels
+	FT_Int32 loadFlags;
+
+	// Coverage size of the glyph last loaded
+	uint16_t coverageW;
+	uint16_t coverageH;
+
+	std::vector<uint8_t> coverage; // Distance field input, reused between glyphs
+	DistanceFieldGenerator distanceFieldGenerator;
+};
+
+// Rasterizes glyphs on a background thread so cache misses don't stall
+// the frame. Requests for a glyph already in flight are ignored until
+// its bitmap has been collected with Poll, and requests for one that
+// failed to rasterize are ignored from then on.
+struct AsyncGlyphRasterizer {
+	AsyncGlyphRasterizer(const FontSet& fonts, size_t fontSize, uint16_t spread, FontStyle style = FontStyle::Regular, uint8_t subpixelPositions = 1);
+	~AsyncGlyphRasterizer();
+
+	void Request(uint32_t c);
+
+	// Moves the finished bitmaps into out, replacing its contents
+	void Poll(std::vector<GlyphBitmap>& out);
+
+	void Run();
+
+	GlyphRasterizer rasterizer;
+	std::thread thread;
+	std::mutex mutex;
+	std::condition_variable wake;
+	std::deque<uint32_t> requests;
+	std::vector<GlyphBitmap> finished;
+	std::unordered_set<uint32_t> inFlight;
+	std::unordered_set<uint32_t> failed; // Same font and key, same failure
+	bool stop;
+};
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+// Where a cached glyph lives in the atlas
+struct Glyph {
+	uint32_t codepoint = 0;
+	uint16_t x = 0, y = 0, w = 0, h = 0;
+	uint16_t slotW = 0, slotH = 0; // Atlas area owned by the glyph, reused on eviction
+	uint16_t page = 0;
+	uint32_t lastUsedFrame = 0;
+	uint32_t placement = 0; // Stamped each time the glyph gets a slot, so holders of its quads can tell it moved
+
+	// Worked out once when the glyph is committed, so laying it out is
+	// a few loads and adds
+	float u0 = 0, v0 = 0, u1 = 0, v1 = 0; // Normalized texture coordinates
+	float offsetX = 0, offsetY = 0; // Bottom-left corner of the quad relative to the pen
+	float width = 0, height = 0;
+	float advance = 0;
+};
+
+// Codepoint to glyph lookup. Latin-1 indexes a flat array directly, so
+// most text never hashes at all, and everything else goes to an open
+// addressing table with linear probing. Both keep the glyphs inline, a
+// lookup touches one or two cache lines instead of a list node.
+//
+// Pointers returned by Find and Insert stay valid until the next Insert or
+// Erase. Insert may grow the table, and Erase shifts later entries back.
+struct GlyphTable {
+	GlyphTable();
+
+	Glyph* Find(uint32_t c);
+	const Glyph* Find(uint32_t c) const;
+
+	// Returns the glyph for c, adding a blank one when it isn't there yet
+	Glyph& Insert(uint32_t c);
+	void Erase(uint32_t c);
+	void Clear();
+
+	size_t Size() const { return count; }
+	bool Empty() const { return count == 0; }
+
+	// Calls f with every glyph in the table, in no particular order
+	template<typename Function>
+	void ForEach(Function f) {
+		for (size_t i = 0; i < DirectSize; i++) {
+			if (direct[i].codepoint == i) {
+				f(direct[i]);
+			}
+		}
+
+		for (Glyph& glyph : slots) {
+			if (glyph.codepoint != NoCodepoint) {
+				f(glyph);
+			}
+		}
+	}
+
+	void Grow();
+	size_t Home(uint32_t c) const;
+
+	static const size_t DirectSize = 256;
+	static const uint32_t NoCodepoint = 0xFFFFFFFF; // Never a valid codepoint
+
+	// A direct slot is in use when its codepoint matches its index
+	Glyph direct[DirectSize];
+	std::vector<Glyph> slots; // Power of two sized
+	uint32_t shift; // 32 - log2(slots.size()), for the multiplicative hash
+	size_t count;
+	size_t hashedCount;
+};
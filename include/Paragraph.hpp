@@ -0,0 +1,89 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include "FontFace.hpp"
+
+enum class TextAlign {
+	Left,
+	Center,
+	Right
+};
+
+// Sizes are in pixels at the face's font size
+struct ParagraphDesc {
+	float wrapWidth = 0; // Lines longer than this break at a word boundary, 0 to only break at '\n'
+	TextAlign align = TextAlign::Left;
+	float tabWidth = 0; // Distance between tab stops, 0 for four spaces
+};
+
+// One line of a paragraph as it's displayed
+struct ParagraphLine {
+	size_t start; // First codepoint in the paragraph's text
+	size_t length; // Codepoints on the line, not counting the '\n' ending it
+	float width; // Without the trailing spaces
+	bool hardBreak; // Ended by a '\n' rather than wrapped
+	ShapedRun run; // Glyphs relative to the start of the line's baseline
+};
+
+// Text broken into lines that fit a wrap width. The lines are kept
+// between edits, and an edit only lays out the lines from the one before
+// it up to where the breaks line up with the old ones again, so typing
+// into a large paragraph costs about a line of layout.
+//
+// Breaks are found with the advances and kerning of FontMetrics, each
+// line is then shaped on its own. With HarfBuzz the shaped line can be
+// wider or narrower than the measured width, ligatures and the font's
+// own positioning aren't seen when breaking, so a line can overhang the
+// wrap width and alignment can be off by that difference.
+struct Paragraph {
+	Paragraph(FontFace& face, const ParagraphDesc& desc = ParagraphDesc());
+
+	void SetText(const uint32_t* text, size_t length);
+
+	// Replaces removed codepoints at at with the inserted ones
+	void Replace(size_t at, size_t removed, const uint32_t* inserted, size_t count);
+	void Insert(size_t at, const uint32_t* inserted, size_t count);
+	void Erase(size_t at, size_t count);
+
+	// Changing the wrap width or tab stops lays out everything again,
+	// alignment only moves lines when they're drawn
+	void SetWrapWidth(float wrapWidth);
+	void SetTabWidth(float tabWidth);
+	void SetAlign(TextAlign align);
+
+	// Index of the line holding the codepoint at position
+	size_t FindLine(size_t position) const;
+
+	// Horizontal offset of a line for the paragraph's alignment
+	float GetLineOffset(const ParagraphLine& line) const;
+
+	// Lays out lines from lines[first] on until one starts where an old
+	// line started, editEnd codepoints in and delta further along than
+	// before the edit
+	void LayoutLines(size_t first, size_t editEnd, ptrdiff_t delta);
+	void LayoutLine(size_t start, ParagraphLine& line);
+	void ShapeLine(ParagraphLine& line);
+
+	float Measure(const uint32_t* text, size_t length);
+	float NextTabStop(float x) const;
+
+	FontFace& face;
+	TextShaper& shaper;
+	FontMetrics& metrics;
+	ParagraphDesc desc;
+	float tabWidth;
+	float maxWidth; // Widest line, what unwrapped text is aligned in
+
+	std::vector<uint32_t> text;
+	std::vector<ParagraphLine> lines; // Always at least one, even for no text
+	std::vector<ParagraphLine> newLines; // Reused by LayoutLines
+
+	struct LayoutStats {
+		size_t linesLaidOut = 0; // By the last edit
+		size_t totalLinesLaidOut = 0;
+	};
+
+	LayoutStats layoutStats;
+};
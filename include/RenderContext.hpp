@@ -6,9 +6,15 @@
 
 #include "Math.hpp"
 
+enum class TextureFormat {
+	RGBA8,
+	Alpha8 // One byte per texel, samples as (0, 0, 0, a) on GLES2
+};
+
 struct TextureDesc {
 	size_t width;
 	size_t height;
+	TextureFormat format;
 };
 
 struct Texture {
@@ -37,13 +43,21 @@ struct RenderContext {
 	SDL_Window* window;
 };
 
+enum class BlendMode {
+	Alpha, // Blended over what's already drawn by the source alpha
+	Opaque
+};
+
 struct RenderCall {
 	GLuint texture;
 	GLuint vertexBuffer;
 	GLuint indexBuffer;
 	GLuint program;
-	uint16_t indexBase;
-	uint16_t numVertices; // Number of vertices to draw
+	uint32_t indexBase; // Byte offset into the index buffer
+	uint32_t numVertices; // Number of vertices to draw
+	Math::Vector2f translation; // Added to every position, for moving retained geometry
+	Math::Vector3f color; // Multiplies every vertex color
+	BlendMode blend;
 };
 
 bool CreateRenderContext(const RenderContextDesc& desc, RenderContext& renderContext);
@@ -54,4 +68,7 @@ GLuint CompileShader(RenderContext& renderContext, GLenum shaderType, const void
 GLuint CreateGraphicsProgram(RenderContext& context, GLuint vertexShader, GLuint fragmentShader);
 TextureHandle LoadTexture(const void* buffer, size_t size);
 TextureHandle CreateGraphicsTexture(TextureDesc& desc, const void* initial);
+void UpdateGraphicsTexture(TextureHandle& texture, size_t x, size_t y, size_t width, size_t height, const void* data);
+size_t GetTextureFormatSize(TextureFormat format);
+// Only changes the GL state that differs from the call before
 void SubmitRenderCalls(RenderContext& context, const RenderCall* renderCalls, size_t numRenderCalls);
\ No newline at end of file
@@ -0,0 +1,12 @@
+#pragma once
+
+// Vector instructions the SIMD paths are built with, SSE2 on x86 and
+// NEON on AArch64 where they're always there. Anything else gets the
+// scalar code.
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define HAS_SSE2 1
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#define HAS_NEON 1
+#endif
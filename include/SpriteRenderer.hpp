@@ -1,27 +1,90 @@
 #pragma once
 
 #include "RenderContext.hpp"
-#include <SDL2/SDL_ttf.h>
+
+enum class SpriteShader {
+	Rgba,
+	Alpha, // Coverage in the alpha channel of single channel textures
+	DistanceField, // Signed distance in alpha, edge softness read from a_normal.x
+	Count
+};
+
+// Writes the four corners of a quad, dst is x, y, width, height and src
+// the texture coordinates of its bottom-left and top-right corners
+void BuildQuadVertices(const Math::Vector4f& src, const Math::Vector4f& dst, const Math::Vector3f& color, const Math::Vector3f& normal, SpriteVertex out[4]);
 
 struct SpriteRenderer {
-	SpriteRenderer(RenderContext& context, const uint16_t MaxSprites);
+	// Indices are 16-bit, so at most MaxSpritesLimit sprites fit in a frame
+	SpriteRenderer(RenderContext& context, size_t maxSprites);
 	~SpriteRenderer();
 
 	void PushSprite(TextureHandle textureHandle, const Math::Vector4f& src, const Math::Vector4f& dst, const Math::Vector3f& color);
+
+	// Quads pushed between BeginBatch and EndBatch share one render call.
+	// A batch drawn with the same texture, shader and blend mode as the
+	// one right before it carries on that batch's call, so runs of
+	// sprites and strings from one texture cost a single draw.
+	void BeginBatch(TextureHandle textureHandle);
+	void BeginBatch(TextureHandle textureHandle, SpriteShader shader);
+	void PushQuad(const Math::Vector4f& src, const Math::Vector4f& dst, const Math::Vector3f& color, const Math::Vector3f& normal = Math::Vector3f());
+
+	// Adds quads built earlier by PushQuad, four vertices each
+	void PushQuads(const SpriteVertex* quadVertices, size_t numQuads);
+
+	// Adds numQuads quads to the batch and returns their vertices for the
+	// caller to fill in, four per quad. The indices are written already.
+	// numQuads is cut down to what fits.
+	SpriteVertex* ReserveQuads(size_t& numQuads);
+	void EndBatch();
+
+	// True when numQuads more quads fit in this frame. Quads and calls
+	// pushed past the end are dropped and counted in overflowStats.
+	bool HasRoom(size_t numQuads) const;
+
+	// Adds a call drawing from buffers owned by someone else, in order
+	// with the sprites around it
+	void PushRenderCall(const RenderCall& call);
+
+	// How everything pushed from now on is blended, Alpha to start with
+	void SetBlendMode(BlendMode blend);
 	void BuildCommandList(RenderCall* out, size_t& outCount);
 
+	// Drops everything pushed since the last BuildCommandList
+	void Discard();
+	void SetTransform(const Math::Matrix4x4f& mvp);
+
 	SpriteVertex* vertices;
 	uint16_t* indices;
 
 	RenderContext& context;
 	RenderCall* renderCalls;
-	uint16_t numRenderCalls;
+	uint32_t numRenderCalls;
+	RenderCall* batch; // Call quads are being added to, null outside BeginBatch/EndBatch
+	RenderCall overflowCall; // Stands in for batch once renderCalls is full
 	GLuint vertexBuffer;
 	GLuint indexBuffer;
-	GLuint program;
-	uint16_t vbCursor;
-	uint16_t ibCursor;
-	uint16_t rcCursor;
-	uint16_t vbCapacity;
-	uint16_t ibCapacity;
+	GLuint programs[(size_t)SpriteShader::Count];
+	uint32_t vbCursor;
+	uint32_t ibCursor;
+	uint32_t rcCursor;
+	uint32_t vbCapacity;
+	uint32_t ibCapacity;
+	uint32_t frameIndex; // Bumped by BuildCommandList, sprites pushed since belong to this frame
+	BlendMode blendMode;
+
+	static const size_t MaxSpritesLimit = 0x10000 / 4;
+
+	struct OverflowStats {
+		size_t droppedQuads = 0;
+		size_t droppedCalls = 0;
+	};
+
+	OverflowStats overflowStats;
+
+	struct BatchStats {
+		size_t batches = 0; // BeginBatch calls
+		size_t merged = 0; // Of those, carried on the call before
+	};
+
+	BatchStats batchStats;
 };
\ No newline at end of file
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include "RenderContext.hpp"
+
+// Text laid out once into its own GL_STATIC_DRAW buffers. Set its text
+// with TextRenderer::SetText and draw it every frame with
+// TextRenderer::DrawTextBlock. Moving or recoloring it only changes the
+// uniforms of its render calls, the vertices are rebuilt when the text
+// changes or the atlas moves one of its glyphs. Subpixel variants are
+// picked for the block's own origin, so faces using them stay sharpest
+// when the block is drawn at whole pixels.
+struct TextBlock {
+	TextBlock();
+	~TextBlock();
+
+	// Owns its buffers, so it can be moved but not copied
+	TextBlock(const TextBlock&) = delete;
+	TextBlock& operator=(const TextBlock&) = delete;
+	TextBlock(TextBlock&& other) noexcept;
+	TextBlock& operator=(TextBlock&& other) noexcept;
+
+	std::vector<uint32_t> text;
+	float size;
+	uint8_t face; // Of the renderer that set the text
+
+	bool complete; // Every glyph was resident when it was built
+	bool dirty; // Text changed since the last build
+
+	// An incomplete block is rebuilt again at retryFrame, backing off while
+	// its missing glyphs keep failing to place
+	uint32_t retryFrame;
+	uint32_t retryDelay;
+
+	// One render call per atlas page the text touches
+	struct Batch {
+		uint16_t page;
+		uint32_t firstIndex;
+		uint32_t numIndices;
+	};
+
+	std::vector<uint32_t> keys; // Glyphs to mark as used whenever it's drawn
+	std::vector<uint32_t> placements; // Glyph::placement of each key when built
+	std::vector<Batch> batches;
+
+	GLuint vertexBuffer;
+	GLuint indexBuffer;
+};
@@ -1,36 +1,309 @@
 #pragma once
 
 #include <cstdint>
-#include <SDL2/SDL_ttf.h>
+#include <list>
 #include <unordered_map>
 #include "SpriteRenderer.hpp"
+#include "GlyphAtlas.hpp"
+#include "GlyphRasterizer.hpp"
+#include "GlyphTable.hpp"
+#include "FontFace.hpp"
+#include "TextBlock.hpp"
+#include "Paragraph.hpp"
+#include "Document.hpp"
+
+// The font given here becomes face 0, more can be added with AddFace
+struct TextRendererDesc {
+	size_t fontSize = 20; // Reference size glyphs are rasterized at in distance field mode
+	const void* fontBuffer = nullptr;
+	size_t fontBufferSize = 0;
+	FontStyle style = FontStyle::Regular;
+	uint8_t subpixelPositions = 1; // See FontFaceDesc
+
+	// Tried in order for codepoints fontBuffer doesn't have
+	const FontSource* fallbackFonts = nullptr;
+	size_t numFallbackFonts = 0;
+	GlyphAtlasDesc atlas;
+
+	// Stores glyphs as signed distance fields so one atlas can be drawn
+	// at any size, spread is how many texels the field reaches past the outline
+	bool distanceField = false;
+	uint16_t distanceFieldSpread = 4;
+
+	// Cache misses are rasterized on a background thread and skipped until
+	// they land in the atlas at the next UpdateTexture
+	bool asyncRasterization = false;
+
+	// How many laid out strings to keep the quads of, 0 turns it off
+	size_t layoutCacheSize = 64;
+};
+
+// Inclusive range of codepoints
+struct CodepointRange {
+	uint32_t first;
+	uint32_t last;
+};
+
+// One string of a WriteStrings batch
+struct TextRun {
+	const char* text = nullptr; // UTF-8
+	size_t length = 0;
+	Math::Vector2f position;
+	Math::Vector3f color = Math::Vector3f(1, 1, 1);
+	uint8_t face = 0;
+	float size = 0; // 0 for the face's own size
+};
+
+// Size of a string laid out like WriteString, in pixels at the size it
+// would be drawn at
+struct TextExtents {
+	float width = 0; // Of the widest line
+	float height = 0; // numLines full lines
+	size_t numLines = 0;
+	size_t numCodepoints = 0;
+};
 
 struct TextRenderer {
 	TextRenderer(SpriteRenderer& spriteRenderer, size_t fontSize, const void* fontBuffer, size_t size);
+	TextRenderer(SpriteRenderer& spriteRenderer, const TextRendererDesc& desc);
 	~TextRenderer();
-	void AddCharacter(uint32_t c);
+
+	// Adds another font, size or style drawing into the same atlas. Up to
+	// MaxFaces, returns false once there's no room.
+	bool AddFace(const FontFaceDesc& desc, uint8_t& id);
+
+	// Face used by everything drawn after, and the size strings are drawn
+	// at when none is given
+	void SetFace(uint8_t id);
+	FontFace& GetFace();
+	FontFace& GetFace(uint8_t id);
+
+	// Rasterizes a glyph key, the face it's drawn with is part of the key
+	bool AddCharacter(uint32_t c);
+	bool CommitGlyph(const GlyphBitmap& bitmap);
+
+	// Finds room for a glyph with the size and metrics of bitmap and adds
+	// its record, leaving the pixels to the caller
+	Glyph* PlaceGlyph(const GlyphBitmap& bitmap);
+
+	// Rasterizes every glyph of the current face in the ranges that isn't
+	// cached yet on a pool of numThreads workers (0 picks one per core),
+	// then packs them all and uploads the atlas once
+	void Prewarm(const CodepointRange* ranges, size_t numRanges, size_t numThreads = 0);
+
+	// Saves the atlas pages and glyph table so a later run with the same
+	// faces and rasterizer settings can skip rasterizing. LoadCache
+	// only works on a renderer with nothing cached yet and returns false
+	// when the file is missing or was written with different settings.
+	bool SaveCache(const char* path);
+	bool LoadCache(const char* path);
+
+	// Strings are UTF-8, UTF-16 or UTF-32 depending on the character type,
+	// length counts code units. WriteCodepoints takes text that's already
+	// decoded, so only Unicode scalar values.
 	void WriteString(Math::Vector2f position, Math::Vector3f color, const char* message, size_t length);
+	void WriteString(Math::Vector2f position, Math::Vector3f color, const char* message, size_t length, float size);
+	void WriteString(Math::Vector2f position, Math::Vector3f color, const char16_t* message, size_t length);
+	void WriteString(Math::Vector2f position, Math::Vector3f color, const char16_t* message, size_t length, float size);
+	void WriteString(Math::Vector2f position, Math::Vector3f color, const char32_t* message, size_t length);
+	void WriteString(Math::Vector2f position, Math::Vector3f color, const char32_t* message, size_t length, float size);
+	void WriteCodepoints(Math::Vector2f position, Math::Vector3f color, const uint32_t* text, size_t length, float size);
+	SpriteShader GetShader() const;
+
+	// Draws many strings at once, for screens full of short labels. All
+	// the glyphs are looked up first, then each atlas page gets a single
+	// render call with room for all of its quads reserved up front. Runs
+	// are drawn a page at a time, so where runs on different pages
+	// overlap they don't necessarily stack in array order. Skips the
+	// layout and shaping caches, runs with a face that doesn't exist are
+	// ignored.
+	void WriteStrings(const TextRun* runs, size_t numRuns);
+
+	// Lays a string out with the current face like WriteString without
+	// drawing or rasterizing anything. carets gets up to maxCarets pen
+	// positions relative to where the string would be drawn, one in front
+	// of each codepoint and one after the last. Never allocates once the
+	// face's metrics have seen the codepoints past Latin-1, which drawing
+	// or measuring the text once takes care of. The measurement uses the
+	// advances and kerning of FontMetrics, so with HarfBuzz it doesn't
+	// see ligatures, marks or the font's own positioning and the extents
+	// and carets can be off from what WriteString draws.
+	void MeasureString(const char* message, size_t length, TextExtents& out, Math::Vector2f* carets = nullptr, size_t maxCarets = 0);
+	void MeasureString(const char* message, size_t length, float size, TextExtents& out, Math::Vector2f* carets = nullptr, size_t maxCarets = 0);
+	void MeasureCodepoints(const uint32_t* text, size_t length, float size, TextExtents& out, Math::Vector2f* carets = nullptr, size_t maxCarets = 0);
+
+	// Adds quads for the glyphs of run on one atlas page, origin is where
+	// the run starts and scale goes from the face's size to the drawn one
+	void PushRunQuads(const FontFace& face, const ShapedRun& run, uint16_t page, Math::Vector2f origin, Math::Vector3f color, Math::Vector3f normal, float scale);
+
+	// Makes every glyph of the run resident and marks it used this frame,
+	// returns a mask of the pages they're on. keys gets the glyphs without
+	// duplicates and complete is cleared when any of them is missing.
+	// originX and scale have to match PushRunQuads, they decide which
+	// subpixel variant each glyph is drawn from.
+	uint32_t MakeResident(const FontFace& face, const ShapedRun& run, float originX, float scale, std::vector<uint32_t>* keys, bool* complete);
+
+	// Key of the glyph drawn with its pen at x, in the face's pixels. With
+	// subpixel positioning x is moved back to the whole pixel the nearest
+	// phase variant is drawn from.
+	uint32_t SnapToPhase(const FontFace& face, uint32_t key, float& x) const;
+
+	// Retained text, see TextBlock. SetText does nothing when the text,
+	// face and size didn't change.
+	void SetText(TextBlock& block, const char* message, size_t length);
+	void SetText(TextBlock& block, const char* message, size_t length, float size);
+	void BuildTextBlock(TextBlock& block);
+	void DrawTextBlock(TextBlock& block, Math::Vector2f position, Math::Vector3f color);
+
+	// Draws every line of a paragraph with its own face, position is the
+	// bottom of the first line at the left edge of the wrap width
+	void DrawParagraph(Paragraph& paragraph, Math::Vector2f position, Math::Vector3f color);
+	void DrawParagraph(Paragraph& paragraph, Math::Vector2f position, Math::Vector3f color, float size);
+
+	// Draws the lines of a document that show through a viewport height
+	// pixels tall, scrolled down by scrollY. position is the viewport's top
+	// left corner. Only those lines are decoded, shaped and drawn, so the
+	// cost follows the viewport and not the file. scrollY is a double, a
+	// float loses whole pixels past a few million of them.
+	void DrawDocument(Document& document, Math::Vector2f position, Math::Vector3f color, double scrollY, float height);
+	void DrawDocument(Document& document, Math::Vector2f position, Math::Vector3f color, double scrollY, float height, float size);
+
 	void UpdateTexture();
+	void CommitFinishedGlyphs();
+	bool EvictFor(uint16_t w, uint16_t h, AtlasRect& out, uint16_t& page);
+
+	// Fills in the texture coordinates and quad of a glyph placed in the atlas
+	void SetGlyphMetrics(Glyph& glyph, int16_t bearingX, int16_t bearingY, uint16_t advance) const;
 
 	SpriteRenderer& spriteRenderer;
 
-	TextureHandle cacheTexture;
-	SDL_Surface* cacheSurface;
-	uint8_t* charScratch; // Scratchpad for flipping characters, is cache surface size to avoid being too small :/
+	GlyphAtlas atlas;
 
-	struct Clip {
-		uint16_t x = 0, y = 0, w = 0, h = 0;
+	GlyphTable glyphs;
+
+	struct CacheStats {
+		size_t hits = 0;
+		size_t misses = 0;
+		size_t evictions = 0;
+	};
+
+	CacheStats cacheStats;
+
+	// Quads of a string drawn before, replayed as long as none of its
+	// glyphs moved in the atlas since
+	struct CachedLayout {
+		uint64_t hash = 0;
+		std::vector<uint32_t> text;
+		Math::Vector2f position;
+		Math::Vector3f color;
+		float size = 0;
+		uint8_t face = 0;
+
+		uint32_t generation = 0; // atlasGeneration the quads were built at
+		bool complete = false; // Every glyph was resident, only then is it replayed
+
+		struct Batch {
+			uint16_t page;
+			size_t firstVertex;
+			size_t numQuads;
+		};
+
+		std::vector<uint32_t> keys; // Glyphs to mark as used on replay
+		std::vector<Batch> batches;
+		std::vector<SpriteVertex> vertices;
 	};
 
-	std::unordered_map<uint32_t, Clip> clips;
+	CachedLayout* FindLayout(uint64_t hash, Math::Vector2f position, Math::Vector3f color, const uint32_t* text, size_t length, float size, uint8_t face);
+	CachedLayout& RecycleLayout(uint64_t hash);
+	void ReplayLayout(const CachedLayout& layout);
+
+	size_t layoutCapacity;
+	std::list<CachedLayout> layouts; // Most recently used first
+	std::unordered_map<uint64_t, std::list<CachedLayout>::iterator> layoutLookup;
+	uint32_t atlasGeneration; // Bumped whenever glyphs leave or move in the atlas
+	uint32_t numPlacements; // Slots handed to glyphs so far, stamped into Glyph::placement
+
+	struct LayoutStats {
+		size_t hits = 0;
+		size_t misses = 0;
+	};
+
+	LayoutStats layoutStats;
+
+	// How often glyphs were looked up and added at each phase, to weigh
+	// the atlas space subpixel positioning costs against how it's used
+	struct SubpixelStats {
+		size_t lookups[MaxSubpixelPositions] = {};
+		size_t added[MaxSubpixelPositions] = {};
+	};
+
+	SubpixelStats subpixelStats;
+
+	std::vector<FontFace*> faces;
+	uint8_t currentFace;
+	bool asyncRasterization;
 
-	size_t fontSize;
-	TTF_Font* font;
-	uint16_t xOffset;
-	uint16_t yOffset;
-	uint16_t yMax;
+	bool distanceField;
+	uint16_t spread; // Border around each glyph in distance field mode, 0 otherwise
+
+	GlyphBitmap glyphScratch; // Reused by AddCharacter when glyphs can't be rendered in place
+
+	std::vector<uint32_t> codepoints; // Decoded strings, reused between calls
+	std::vector<SpriteVertex> blockVertices; // Staging for BuildTextBlock
+	std::vector<uint16_t> blockIndices;
+	std::vector<ShapedRun> documentRuns; // Visible lines of the last DrawDocument
+
+	// A glyph of WriteStrings, placed and waiting for its page's turn
+	struct BatchQuad {
+		uint16_t page;
+		Math::Vector4f src;
+		Math::Vector4f dst;
+		Math::Vector3f color;
+		Math::Vector3f normal;
+	};
+
+	std::vector<BatchQuad> batchQuads;
+	ShapedRun batchRun; // Run of WriteStrings being placed
+
+	std::vector<GlyphBitmap> finishedGlyphs;
+
+	// Glyphs that couldn't be placed in the atlas, to the frame they're
+	// tried again at, so a full atlas doesn't rasterize them every frame
+	std::unordered_map<uint32_t, uint32_t> failedGlyphs;
+	static const uint32_t FailedGlyphRetryFrames = 60;
+
+	// Glyphs EvictFor may take, least recently used first, built once per
+	// frame that needs it instead of scanning the table for every miss
+	struct EvictionCandidate {
+		uint32_t key;
+		uint32_t lastUsedFrame;
+		uint32_t area;
+	};
+
+	std::vector<EvictionCandidate> evictionQueue;
+	size_t evictionCursor; // Entries before it are taken
+	uint32_t evictionFrame; // frameIndex the queue was built at
+	std::vector<uint32_t> evictionVictims; // Glyphs in the area EvictFor is clearing
+
+	// When no single slot is big enough, how many areas of the atlas are
+	// looked at and how many glyphs can be cleared out of one, so a large
+	// glyph doesn't empty the atlas
+	static const size_t MaxAreasPerGlyph = 8;
+	static const size_t MaxVictimsPerGlyph = 64;
+
+	// Returns the candidate's glyph, or null and marks it taken when it
+	// was drawn or removed since the queue was built
+	const Glyph* FindCandidate(EvictionCandidate& candidate);
+	AtlasRect Evict(uint32_t key, uint16_t& page);
 
 	// Change padding here to prevent bleeding
 	static const uint16_t PaddingX = 0;
 	static const uint16_t PaddingY = 0;
+
+	// Face ids have to fit in the glyph keys. Face 255 is left out, with
+	// every other bit set its glyph key would be GlyphTable::NoCodepoint.
+	static const size_t MaxFaces = 255;
+
+	// Longer document lines are cut, only their start is ever on screen
+	static const size_t MaxDocumentLineBytes = 4096;
 };
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include <list>
+#include <unordered_map>
+#include "FontMetrics.hpp"
+
+#ifdef HAS_HARFBUZZ
+#include <hb.h>
+#endif
+
+// A glyph placed by the shaper
+struct ShapedGlyph {
+	uint32_t key; // Glyph table key, a codepoint or a glyph index with GlyphIndexBit set
+	float x; // Pen position relative to the start of the run, in pixels at the font's size
+	float y;
+};
+
+struct ShapedRun {
+	std::vector<ShapedGlyph> glyphs;
+};
+
+// Turns codepoints into positioned glyphs. Built with HarfBuzz
+// (HAS_HARFBUZZ, make HARFBUZZ=1) that covers ligatures, marks and complex scripts, each
+// stretch of text drawn by one font of the set is shaped on its own.
+// Without it, each codepoint becomes one glyph placed with the advances
+// and kerning of FontMetrics. A shaper belongs to one font set at one
+// size, and its runs are cached by their text so strings drawn every
+// frame are only shaped once.
+struct TextShaper {
+	TextShaper(FontMetrics& metrics, const FontSet& fonts, size_t fontSize, size_t capacity = 256);
+	~TextShaper();
+
+	// Returns the run for text, shaping it on a cache miss. The reference
+	// is good until the next call. Line breaks move the pen down a line.
+	const ShapedRun& Shape(const uint32_t* text, size_t length);
+	void ShapeUncached(const uint32_t* text, size_t length, ShapedRun& out);
+	void ShapeLine(const uint32_t* text, size_t length, float y, ShapedRun& out);
+
+#ifdef HAS_HARFBUZZ
+	// Shapes text that's all drawn by one font, returns the pen's x after it
+	float ShapeFontRun(uint8_t font, const uint32_t* text, size_t length, float x, float y, ShapedRun& out);
+#endif
+
+	struct Entry {
+		uint64_t hash;
+		std::vector<uint32_t> text;
+		ShapedRun run;
+	};
+
+	FontMetrics& metrics;
+	const FontSet& fonts;
+	size_t capacity;
+	std::list<Entry> entries; // Most recently used first
+	std::unordered_map<uint64_t, std::list<Entry>::iterator> lookup;
+
+	struct CacheStats {
+		size_t hits = 0;
+		size_t misses = 0;
+	};
+
+	CacheStats cacheStats;
+
+#ifdef HAS_HARFBUZZ
+	// One of each per font of the set
+	std::vector<hb_blob_t*> blobs;
+	std::vector<hb_face_t*> faces;
+	std::vector<hb_font_t*> hbFonts;
+	hb_buffer_t* buffer;
+#endif
+};
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+
+namespace Unicode {
+
+// Codepoint substituted for malformed input
+static const uint32_t ReplacementCharacter = 0xFFFD;
+
+// Decode length code units into codepoints and return how many were
+// written. out needs room for length codepoints, which is the most any
+// input can produce. Malformed sequences each turn into one
+// ReplacementCharacter instead of stopping the decode. For UTF-8 that's
+// a lead with its continuation bytes, or as many of them as there are
+// before the sequence is cut short, and any byte that can't start one.
+// UTF-32 only replaces surrogates and values past U+10FFFF.
+size_t DecodeUtf8(const char* text, size_t length, uint32_t* out);
+size_t DecodeUtf16(const char16_t* text, size_t length, uint32_t* out);
+size_t DecodeUtf32(const char32_t* text, size_t length, uint32_t* out);
+
+// Returns how much of length bytes of UTF-8 to keep to stay within
+// maxLength without cutting a sequence in half
+size_t TrimUtf8(const char* text, size_t length, size_t maxLength);
+
+}
@@ -2,9 +2,20 @@
 
 #include <fstream>
 #include <vector>
+#include <cstdint>
 
 namespace Utility {
 
+// Read-only view of a whole file, memory mapped where the platform allows
+struct MappedFile {
+	const uint8_t* data = nullptr;
+	size_t size = 0;
+	bool mapped = false;
+	std::vector<uint8_t> fallback; // Holds the contents when mapping isn't available
+};
+
 void LoadFile(const char* path, std::vector<uint8_t>& buffer);
+bool MapFile(const char* path, MappedFile& file);
+void UnmapFile(MappedFile& file);
 
 }
\ No newline at end of file
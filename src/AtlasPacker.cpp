@@ -0,0 +1,474 @@
+#include "AtlasPacker.hpp"
+#include <climits>
+#include <algorithm>
+
+AtlasPacker::AtlasPacker(uint16_t width, uint16_t height) :
+	width(width),
+	height(height),
+	usedArea(0)
+{
+}
+
+float AtlasPacker::Occupancy() const {
+	return (float)usedArea / ((float)width * height);
+}
+
+static AtlasRect MakeRect(int x, int y, int w, int h) {
+	AtlasRect rect;
+	rect.x = (uint16_t)x;
+	rect.y = (uint16_t)y;
+	rect.w = (uint16_t)w;
+	rect.h = (uint16_t)h;
+	return rect;
+}
+
+// Grows rect by any free rectangle it shares a whole edge with, until
+// there's none left, and adds it to rects
+template<typename Rect>
+static void AddMerged(std::vector<Rect>& rects, Rect rect) {
+	for (size_t i = 0; i < rects.size(); i++) {
+		const Rect& other = rects[i];
+		const bool Row = other.y == rect.y && other.h == rect.h &&
+			(other.x + other.w == rect.x || rect.x + rect.w == other.x);
+		const bool Column = other.x == rect.x && other.w == rect.w &&
+			(other.y + other.h == rect.y || rect.y + rect.h == other.y);
+
+		if (!Row && !Column) {
+			continue;
+		}
+
+		const int Left = std::min<int>(rect.x, other.x);
+		const int Bottom = std::min<int>(rect.y, other.y);
+		const int Right = std::max<int>(rect.x + rect.w, other.x + other.w);
+		const int Top = std::max<int>(rect.y + rect.h, other.y + other.h);
+
+		rect.x = Left;
+		rect.y = Bottom;
+		rect.w = Right - Left;
+		rect.h = Top - Bottom;
+
+		rects.erase(rects.begin() + i);
+		i = (size_t)-1; // The grown rectangle may touch ones already passed
+	}
+
+	rects.push_back(rect);
+}
+
+SkylinePacker::SkylinePacker(uint16_t width, uint16_t height) :
+	AtlasPacker(width, height)
+{
+	Reset();
+}
+
+void SkylinePacker::Reset() {
+	skyline.clear();
+	skyline.push_back({ 0, 0, width });
+	freed.clear();
+	usedArea = 0;
+}
+
+int SkylinePacker::Fit(size_t index, int w, int h) const {
+	int x = skyline[index].x;
+	int y = 0;
+	int remaining = w;
+
+	if (x + w > width) {
+		return -1;
+	}
+
+	// The rectangle rests on the highest node it spans
+	while (remaining > 0) {
+		if (index == skyline.size()) {
+			return -1;
+		}
+
+		y = (skyline[index].y > y) ? skyline[index].y : y;
+
+		if (y + h > height) {
+			return -1;
+		}
+
+		remaining -= skyline[index].w;
+		index++;
+	}
+
+	return y;
+}
+
+bool SkylinePacker::Pack(uint16_t w, uint16_t h, AtlasRect& out) {
+	if (w == 0 || h == 0) {
+		out = AtlasRect();
+		out.w = w;
+		out.h = h;
+		return true;
+	}
+
+	if (PackFreed(w, h, out)) {
+		usedArea += (size_t)w * h;
+		return true;
+	}
+
+	size_t bestIndex = SIZE_MAX;
+	int bestTop = INT_MAX;
+	int bestWidth = INT_MAX;
+	int bestY = 0;
+
+	// Bottom-left rule, lowest top edge wins and the narrower
+	// node breaks ties so gaps get filled first
+	for (size_t i = 0; i < skyline.size(); i++) {
+		int y = Fit(i, w, h);
+
+		if (y < 0) {
+			continue;
+		}
+
+		if (y + h < bestTop || (y + h == bestTop && skyline[i].w < bestWidth)) {
+			bestIndex = i;
+			bestTop = y + h;
+			bestWidth = skyline[i].w;
+			bestY = y;
+		}
+	}
+
+	if (bestIndex == SIZE_MAX) {
+		return false;
+	}
+
+	out.x = (uint16_t)skyline[bestIndex].x;
+	out.y = (uint16_t)bestY;
+	out.w = w;
+	out.h = h;
+
+	// Raise the skyline under the new rectangle
+	Node node = { out.x, bestTop, w };
+	skyline.insert(skyline.begin() + bestIndex, node);
+
+	// Trim or drop the nodes it now covers
+	for (size_t i = bestIndex + 1; i < skyline.size(); i++) {
+		const Node& prev = skyline[i - 1];
+		Node& cur = skyline[i];
+
+		if (cur.x >= prev.x + prev.w) {
+			break;
+		}
+
+		int shrink = prev.x + prev.w - cur.x;
+		cur.x += shrink;
+		cur.w -= shrink;
+
+		if (cur.w > 0) {
+			break;
+		}
+
+		skyline.erase(skyline.begin() + i);
+		i--;
+	}
+
+	MergeNodes();
+
+	usedArea += (size_t)w * h;
+	return true;
+}
+
+void SkylinePacker::Reserve(const AtlasRect& rect) {
+	if (rect.w == 0 || rect.h == 0) {
+		return;
+	}
+
+	const int Left = rect.x;
+	const int Right = rect.x + rect.w;
+	const int Top = rect.y + rect.h;
+	std::vector<Node> raised;
+
+	// Split the nodes at the rectangle's edges and lift the ones in
+	// between to its top. Anything under it is given up, the skyline
+	// can't represent holes.
+	for (const Node& node : skyline) {
+		const int NodeRight = node.x + node.w;
+
+		if (node.x < Left) {
+			raised.push_back({ node.x, node.y, std::min(NodeRight, Left) - node.x });
+		}
+
+		const int OverlapLeft = std::max(node.x, Left);
+		const int OverlapRight = std::min(NodeRight, Right);
+
+		if (OverlapLeft < OverlapRight) {
+			raised.push_back({ OverlapLeft, std::max(node.y, Top), OverlapRight - OverlapLeft });
+		}
+
+		if (NodeRight > Right) {
+			const int RightStart = std::max(node.x, Right);
+			raised.push_back({ RightStart, node.y, NodeRight - RightStart });
+		}
+	}
+
+	skyline.swap(raised);
+	MergeNodes();
+
+	// Freed holes it overlaps keep the strips around it
+	const size_t Count = freed.size();
+
+	for (size_t i = 0; i < Count; i++) {
+		const AtlasRect Hole = freed[i];
+		const int HoleRight = Hole.x + Hole.w;
+		const int HoleTop = Hole.y + Hole.h;
+
+		if (Left >= HoleRight || Right <= Hole.x || rect.y >= HoleTop || Top <= Hole.y) {
+			continue;
+		}
+
+		const int MiddleLeft = std::max<int>(Hole.x, Left);
+		const int MiddleRight = std::min(HoleRight, Right);
+
+		if (Left > Hole.x) {
+			freed.push_back(MakeRect(Hole.x, Hole.y, Left - Hole.x, Hole.h));
+		}
+		if (Right < HoleRight) {
+			freed.push_back(MakeRect(Right, Hole.y, HoleRight - Right, Hole.h));
+		}
+		if (rect.y > Hole.y) {
+			freed.push_back(MakeRect(MiddleLeft, Hole.y, MiddleRight - MiddleLeft, rect.y - Hole.y));
+		}
+		if (Top < HoleTop) {
+			freed.push_back(MakeRect(MiddleLeft, Top, MiddleRight - MiddleLeft, HoleTop - Top));
+		}
+
+		freed[i].w = 0; // Dropped below
+	}
+
+	freed.erase(std::remove_if(freed.begin(), freed.end(), [](const AtlasRect& hole) { return hole.w == 0; }), freed.end());
+
+	usedArea += (size_t)rect.w * rect.h;
+}
+
+void SkylinePacker::Free(const AtlasRect& rect) {
+	if (rect.w == 0 || rect.h == 0) {
+		return;
+	}
+
+	AddMerged(freed, rect);
+	usedArea -= (size_t)rect.w * rect.h;
+}
+
+bool SkylinePacker::PackFreed(uint16_t w, uint16_t h, AtlasRect& out) {
+	size_t best = SIZE_MAX;
+	size_t bestArea = SIZE_MAX;
+
+	// Smallest hole that fits
+	for (size_t i = 0; i < freed.size(); i++) {
+		const size_t Area = (size_t)freed[i].w * freed[i].h;
+
+		if (freed[i].w >= w && freed[i].h >= h && Area < bestArea) {
+			best = i;
+			bestArea = Area;
+		}
+	}
+
+	if (best == SIZE_MAX) {
+		return false;
+	}
+
+	const AtlasRect Hole = freed[best];
+	freed.erase(freed.begin() + best);
+
+	out.x = Hole.x;
+	out.y = Hole.y;
+	out.w = w;
+	out.h = h;
+
+	// What's left goes back as the strip beside the rectangle and the one
+	// above it, split along the shorter leftover so the larger piece stays whole
+	AtlasRect side = Hole;
+	AtlasRect above = Hole;
+
+	if (Hole.w - w < Hole.h - h) {
+		side.x += w;
+		side.w -= w;
+		side.h = h;
+		above.y += h;
+		above.h -= h;
+	}
+	else {
+		side.x += w;
+		side.w -= w;
+		above.y += h;
+		above.h -= h;
+		above.w = w;
+	}
+
+	if (side.w > 0 && side.h > 0) {
+		freed.push_back(side);
+	}
+
+	if (above.w > 0 && above.h > 0) {
+		freed.push_back(above);
+	}
+
+	return true;
+}
+
+void SkylinePacker::MergeNodes() {
+	for (size_t i = 0; i + 1 < skyline.size(); i++) {
+		if (skyline[i].y == skyline[i + 1].y) {
+			skyline[i].w += skyline[i + 1].w;
+			skyline.erase(skyline.begin() + i + 1);
+			i--;
+		}
+	}
+}
+
+MaxRectsPacker::MaxRectsPacker(uint16_t width, uint16_t height) :
+	AtlasPacker(width, height)
+{
+	Reset();
+}
+
+void MaxRectsPacker::Reset() {
+	freeRects.clear();
+	freeRects.push_back({ 0, 0, width, height });
+	usedArea = 0;
+}
+
+bool MaxRectsPacker::Pack(uint16_t w, uint16_t h, AtlasRect& out) {
+	if (w == 0 || h == 0) {
+		out = AtlasRect();
+		out.w = w;
+		out.h = h;
+		return true;
+	}
+
+	int bestShortSide = INT_MAX;
+	int bestLongSide = INT_MAX;
+	Rect best = {};
+
+	// Best short side fit, the free rectangle leaving the smallest
+	// leftover along its tighter axis wins
+	for (const Rect& free : freeRects) {
+		if (free.w < w || free.h < h) {
+			continue;
+		}
+
+		int leftoverW = free.w - w;
+		int leftoverH = free.h - h;
+		int shortSide = (leftoverW < leftoverH) ? leftoverW : leftoverH;
+		int longSide = (leftoverW < leftoverH) ? leftoverH : leftoverW;
+
+		if (shortSide < bestShortSide || (shortSide == bestShortSide && longSide < bestLongSide)) {
+			best = { free.x, free.y, w, h };
+			bestShortSide = shortSide;
+			bestLongSide = longSide;
+		}
+	}
+
+	if (bestShortSide == INT_MAX) {
+		return false;
+	}
+
+	SplitFreeRects(best);
+	PruneFreeRects();
+
+	out.x = (uint16_t)best.x;
+	out.y = (uint16_t)best.y;
+	out.w = w;
+	out.h = h;
+
+	usedArea += (size_t)w * h;
+	return true;
+}
+
+void MaxRectsPacker::Reserve(const AtlasRect& rect) {
+	if (rect.w == 0 || rect.h == 0) {
+		return;
+	}
+
+	SplitFreeRects({ rect.x, rect.y, rect.w, rect.h });
+	PruneFreeRects();
+
+	usedArea += (size_t)rect.w * rect.h;
+}
+
+void MaxRectsPacker::Free(const AtlasRect& rect) {
+	if (rect.w == 0 || rect.h == 0) {
+		return;
+	}
+
+	AddMerged(freeRects, Rect{ rect.x, rect.y, rect.w, rect.h });
+	PruneFreeRects();
+
+	usedArea -= (size_t)rect.w * rect.h;
+}
+
+void MaxRectsPacker::SplitFreeRects(const Rect& used) {
+	const size_t Count = freeRects.size();
+
+	for (size_t i = 0; i < Count; i++) {
+		Rect free = freeRects[i];
+
+		if (used.x >= free.x + free.w || used.x + used.w <= free.x ||
+			used.y >= free.y + free.h || used.y + used.h <= free.y) {
+			continue;
+		}
+
+		// Replace the overlapped rectangle with the (up to four) maximal
+		// rectangles around the used area
+		if (used.x > free.x) {
+			freeRects.push_back({ free.x, free.y, used.x - free.x, free.h });
+		}
+		if (used.x + used.w < free.x + free.w) {
+			freeRects.push_back({ used.x + used.w, free.y, free.x + free.w - used.x - used.w, free.h });
+		}
+		if (used.y > free.y) {
+			freeRects.push_back({ free.x, free.y, free.w, used.y - free.y });
+		}
+		if (used.y + used.h < free.y + free.h) {
+			freeRects.push_back({ free.x, used.y + used.h, free.w, free.y + free.h - used.y - used.h });
+		}
+
+		freeRects[i].w = 0; // Marked for removal by PruneFreeRects
+	}
+}
+
+static bool Contains(const MaxRectsPacker::Rect& a, const MaxRectsPacker::Rect& b) {
+	return b.x >= a.x && b.y >= a.y && b.x + b.w <= a.x + a.w && b.y + b.h <= a.y + a.h;
+}
+
+void MaxRectsPacker::PruneFreeRects() {
+	for (size_t i = 0; i < freeRects.size(); i++) {
+		if (freeRects[i].w == 0) {
+			continue;
+		}
+
+		for (size_t j = i + 1; j < freeRects.size(); j++) {
+			if (freeRects[j].w == 0) {
+				continue;
+			}
+
+			if (Contains(freeRects[i], freeRects[j])) {
+				freeRects[j].w = 0;
+			}
+			else if (Contains(freeRects[j], freeRects[i])) {
+				freeRects[i].w = 0;
+				break;
+			}
+		}
+	}
+
+	size_t count = 0;
+	for (size_t i = 0; i < freeRects.size(); i++) {
+		if (freeRects[i].w != 0) {
+			freeRects[count++] = freeRects[i];
+		}
+	}
+	freeRects.resize(count);
+}
+
+AtlasPacker* CreateAtlasPacker(AtlasPackerType type, uint16_t width, uint16_t height) {
+	switch (type) {
+	case AtlasPackerType::MaxRects:
+		return new MaxRectsPacker(width, height);
+	case AtlasPackerType::Skyline:
+	default:
+		return new SkylinePacker(width, height);
+	}
+}
@@ -0,0 +1,111 @@
+#include "DistanceField.hpp"
+#include <algorithm>
+#include <cmath>
+
+static const float Infinity = 1e20f;
+
+// Felzenszwalb & Huttenlocher's squared distance transform of a sampled
+// function, lower envelope of the parabolas rooted at each sample
+static void Transform1D(const float* f, int n, float* d, int* v, float* z) {
+	int k = 0;
+
+	v[0] = 0;
+	z[0] = -Infinity;
+	z[1] = Infinity;
+
+	for (int q = 1; q < n; q++) {
+		float s = ((f[q] + q * q) - (f[v[k]] + v[k] * v[k])) / (2 * q - 2 * v[k]);
+
+		while (s <= z[k]) {
+			k--;
+			s = ((f[q] + q * q) - (f[v[k]] + v[k] * v[k])) / (2 * q - 2 * v[k]);
+		}
+
+		k++;
+		v[k] = q;
+		z[k] = s;
+		z[k + 1] = Infinity;
+	}
+
+	k = 0;
+
+	for (int q = 0; q < n; q++) {
+		while (z[k + 1] < q) {
+			k++;
+		}
+
+		d[q] = (float)(q - v[k]) * (q - v[k]) + f[v[k]];
+	}
+}
+
+void DistanceFieldGenerator::Transform(const std::vector<uint8_t>& seed, int w, int h, std::vector<float>& out) {
+	const int N = std::max(w, h);
+
+	out.resize((size_t)w * h);
+	f.resize(N);
+	d.resize(N);
+	z.resize(N + 1);
+	v.resize(N);
+
+	for (size_t i = 0; i < out.size(); i++) {
+		out[i] = seed[i] ? 0 : Infinity;
+	}
+
+	// Separable, columns first then rows
+	for (int x = 0; x < w; x++) {
+		for (int y = 0; y < h; y++) {
+			f[y] = out[(size_t)y * w + x];
+		}
+
+		Transform1D(f.data(), h, d.data(), v.data(), z.data());
+
+		for (int y = 0; y < h; y++) {
+			out[(size_t)y * w + x] = d[y];
+		}
+	}
+
+	for (int y = 0; y < h; y++) {
+		float* row = &out[(size_t)y * w];
+
+		std::copy(row, row + w, f.begin());
+		Transform1D(f.data(), w, d.data(), v.data(), z.data());
+		std::copy(d.begin(), d.begin() + w, row);
+	}
+}
+
+void DistanceFieldGenerator::Generate(const uint8_t* src, int w, int h, ptrdiff_t srcPitch, size_t srcStride, int spread, uint8_t* out) {
+	const int OutW = w + 2 * spread;
+	const int OutH = h + 2 * spread;
+	const size_t Size = (size_t)OutW * OutH;
+
+	inside.assign(Size, 0);
+	outside.assign(Size, 1);
+
+	for (int y = 0; y < h; y++) {
+		const uint8_t* s = src + srcPitch * y;
+
+		for (int x = 0; x < w; x++) {
+			const size_t Index = (size_t)(y + spread) * OutW + x + spread;
+			const bool IsInside = s[srcStride * x] >= 0x80;
+
+			inside[Index] = IsInside;
+			outside[Index] = !IsInside;
+		}
+	}
+
+	// Distance from outside texels to the shape, and from inside ones to
+	// the background
+	Transform(inside, OutW, OutH, distanceOutside);
+	Transform(outside, OutW, OutH, distanceInside);
+
+	for (size_t i = 0; i < Size; i++) {
+		// Texel centers sit half a texel off the outline on either side
+		float distance = inside[i] ?
+			std::sqrt(distanceInside[i]) - 0.5f :
+			0.5f - std::sqrt(distanceOutside[i]);
+
+		float value = 0.5f + distance * 0.5f / spread;
+		value = std::min(std::max(value, 0.0f), 1.0f);
+		out[i] = (uint8_t)(value * 255.0f + 0.5f);
+	}
+}
@@ -0,0 +1,124 @@
+#include "Document.hpp"
+#include "Simd.hpp"
+#include <cstring>
+
+// Chunks of 16 bytes without a '\n' are skipped with one compare
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+#if defined(HAS_SSE2)
+static unsigned CountTrailingZeros(unsigned mask) {
+#if defined(_MSC_VER)
+	unsigned long index;
+	_BitScanForward(&index, mask);
+	return (unsigned)index;
+#else
+	return (unsigned)__builtin_ctz(mask);
+#endif
+}
+#endif
+
+// Adds the offset just past every '\n' in [begin, end) to out
+static void FindLineStarts(const uint8_t* data, size_t begin, size_t end, std::vector<size_t>& out) {
+	size_t i = begin;
+
+#if defined(HAS_SSE2)
+	const __m128i Newline = _mm_set1_epi8('\n');
+
+	for (; end - i >= 16; i += 16) {
+		const __m128i Bytes = _mm_loadu_si128((const __m128i*)(data + i));
+		unsigned mask = (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(Bytes, Newline));
+
+		while (mask != 0) {
+			out.push_back(i + CountTrailingZeros(mask) + 1);
+			mask &= mask - 1;
+		}
+	}
+#elif defined(HAS_NEON)
+	const uint8x16_t Newline = vdupq_n_u8('\n');
+
+	for (; end - i >= 16; i += 16) {
+		const uint8x16_t Matches = vceqq_u8(vld1q_u8(data + i), Newline);
+
+		if (vmaxvq_u8(Matches) == 0) {
+			continue;
+		}
+
+		for (size_t j = 0; j < 16; j++) {
+			if (data[i + j] == '\n') {
+				out.push_back(i + j + 1);
+			}
+		}
+	}
+#endif
+
+	// The rest, or all of it without SIMD, memchr is vectorized by most C libraries
+	while (i < end) {
+		const void* found = memchr(data + i, '\n', end - i);
+
+		if (!found) {
+			break;
+		}
+
+		i = (size_t)((const uint8_t*)found - data) + 1;
+		out.push_back(i);
+	}
+}
+
+Document::Document() :
+	indexedBytes(0)
+{
+}
+
+Document::~Document() {
+	Close();
+}
+
+bool Document::Open(const char* path) {
+	Close();
+
+	if (!Utility::MapFile(path, file)) {
+		return false;
+	}
+
+	lineStarts.push_back(0);
+	return true;
+}
+
+void Document::Close() {
+	Utility::UnmapFile(file);
+	lineStarts.clear();
+	indexedBytes = 0;
+}
+
+bool Document::IndexLines(size_t maxBytes) {
+	const size_t End = (file.size - indexedBytes > maxBytes) ? indexedBytes + maxBytes : file.size;
+
+	FindLineStarts(file.data, indexedBytes, End, lineStarts);
+	indexedBytes = End;
+
+	return Indexed();
+}
+
+bool Document::Indexed() const {
+	return indexedBytes == file.size;
+}
+
+size_t Document::NumLines() const {
+	return lineStarts.size();
+}
+
+const char* Document::GetLine(size_t index, size_t& length) const {
+	const size_t Start = lineStarts[index];
+	size_t end = (index + 1 < lineStarts.size()) ? lineStarts[index + 1] - 1 : indexedBytes;
+
+	// Windows line endings
+	if (end > Start && file.data[end - 1] == '\r') {
+		end--;
+	}
+
+	length = end - Start;
+	return (const char*)file.data + Start;
+}
@@ -0,0 +1,40 @@
+#include "FontFace.hpp"
+#include <algorithm>
+
+// The main font followed by the fallbacks
+static FontSet MakeFontSet(const FontFaceDesc& desc) {
+	FontSet fonts;
+
+	fonts.Add(desc.fontBuffer, desc.fontBufferSize);
+
+	for (size_t i = 0; i < desc.numFallbackFonts; i++) {
+		fonts.Add(desc.fallbackFonts[i].buffer, desc.fallbackFonts[i].size);
+	}
+
+	return fonts;
+}
+
+static uint8_t ClampSubpixelPositions(const FontFaceDesc& desc, uint16_t spread) {
+	if (spread > 0 || desc.subpixelPositions < 1) {
+		return 1;
+	}
+
+	return std::min(desc.subpixelPositions, MaxSubpixelPositions);
+}
+
+FontFace::FontFace(const FontFaceDesc& desc, uint8_t id, uint16_t spread) :
+	id(id),
+	fontSize(desc.fontSize),
+	style(desc.style),
+	subpixelPositions(ClampSubpixelPositions(desc, spread)),
+	fonts(MakeFontSet(desc)),
+	rasterizer(fonts, desc.fontSize, spread, desc.style, subpixelPositions),
+	shaper(metrics, fonts, desc.fontSize),
+	asyncRasterizer(nullptr)
+{
+	metrics.Build(rasterizer.faces, fonts, (int)(rasterizer.emboldenStrength >> 6), subpixelPositions > 1);
+}
+
+FontFace::~FontFace() {
+	delete asyncRasterizer;
+}
@@ -0,0 +1,145 @@
+#include "FontMetrics.hpp"
+#include FT_ADVANCES_H
+
+FontMetrics::FontMetrics() :
+	ascender(0),
+	descender(0),
+	lineHeight(0),
+	extraAdvance(0),
+	fractional(false),
+	face(nullptr),
+	fonts(nullptr),
+	hasKerning(false),
+	advances()
+{
+}
+
+void FontMetrics::Build(const std::vector<FT_Face>& fontFaces, const FontSet& fontSet, int extra, bool fractionalAdvances) {
+	faces = fontFaces;
+	extraAdvance = extra;
+	fractional = fractionalAdvances;
+	fonts = &fontSet;
+	face = faces.empty() ? nullptr : faces[0];
+	extendedAdvances.clear();
+	extendedKerning.clear();
+
+	if (!face) {
+		return;
+	}
+
+	// Rounded out the same way as the glyph boxes, so lines never overlap
+	ascender = (int)((face->size->metrics.ascender + 63) >> 6);
+	descender = (int)(face->size->metrics.descender >> 6);
+	lineHeight = (int)((face->size->metrics.height + 63) >> 6);
+
+	FT_UInt indices[DenseSize];
+	FT_Face denseFaces[DenseSize];
+
+	for (uint32_t c = 0; c < DenseSize; c++) {
+		denseFaces[c] = FindFace(c);
+		indices[c] = FT_Get_Char_Index(denseFaces[c], c);
+
+		if (FT_Load_Glyph(denseFaces[c], indices[c], FT_LOAD_NO_BITMAP) != 0) {
+			continue;
+		}
+
+		if (fractional) {
+			advances[c] = denseFaces[c]->glyph->linearHoriAdvance / 65536.0f + extraAdvance;
+		}
+		else {
+			advances[c] = (float)(((denseFaces[c]->glyph->advance.x + 32) >> 6) + extraAdvance);
+		}
+	}
+
+	hasKerning = false;
+	for (FT_Face fontFace : faces) {
+		hasKerning = hasKerning || (fontFace && FT_HAS_KERNING(fontFace));
+	}
+
+	if (!hasKerning) {
+		return;
+	}
+
+	kerning.assign(DenseSize * DenseSize, 0);
+
+	for (size_t left = 0; left < DenseSize; left++) {
+		if (indices[left] == 0) {
+			continue;
+		}
+
+		for (size_t right = 0; right < DenseSize; right++) {
+			FT_Vector delta;
+
+			if (indices[right] == 0 || denseFaces[right] != denseFaces[left]) {
+				continue;
+			}
+
+			if (FT_Get_Kerning(denseFaces[left], indices[left], indices[right], FT_KERNING_DEFAULT, &delta) == 0) {
+				kerning[left * DenseSize + right] = (int8_t)(delta.x >> 6);
+			}
+		}
+	}
+}
+
+float FontMetrics::GetExtendedAdvance(uint32_t c) {
+	auto it = extendedAdvances.find(c);
+
+	if (it != extendedAdvances.end()) {
+		return it->second;
+	}
+
+	// Hinted like the rasterizer's, so both agree on where the pen goes
+	FT_Fixed advance = 0;
+	FT_Face charFace = FindFace(c);
+	const FT_Int32 Flags = fractional ? FT_LOAD_NO_BITMAP | FT_LOAD_NO_HINTING : FT_LOAD_NO_BITMAP;
+
+	if (charFace) {
+		FT_Get_Advance(charFace, FT_Get_Char_Index(charFace, c), Flags, &advance);
+	}
+
+	const float Advance = fractional ?
+		advance / 65536.0f + extraAdvance :
+		(float)(((advance + 0x8000) >> 16) + extraAdvance);
+
+	// Starting over is cheaper than tracking use, and the next lookups
+	// fill it back up with what the text actually needs
+	if (extendedAdvances.size() >= MaxExtendedAdvances) {
+		extendedAdvances.clear();
+	}
+
+	extendedAdvances[c] = Advance;
+
+	return Advance;
+}
+
+int FontMetrics::GetExtendedKerning(uint32_t left, uint32_t right) {
+	const uint64_t Key = ((uint64_t)left << 32) | right;
+	auto it = extendedKerning.find(Key);
+
+	if (it != extendedKerning.end()) {
+		return it->second;
+	}
+
+	// Only reads the kerning table, the glyph slot is left alone
+	FT_Vector delta = {};
+	FT_Face leftFace = FindFace(left);
+
+	if (leftFace && leftFace == FindFace(right)) {
+		FT_Get_Kerning(leftFace, FT_Get_Char_Index(leftFace, left), FT_Get_Char_Index(leftFace, right), FT_KERNING_DEFAULT, &delta);
+	}
+
+	const int16_t Kerning = (int16_t)(delta.x >> 6);
+
+	if (extendedKerning.size() >= MaxExtendedKerning) {
+		extendedKerning.clear();
+	}
+
+	extendedKerning[Key] = Kerning;
+
+	return Kerning;
+}
+
+FT_Face FontMetrics::FindFace(uint32_t c) const {
+	const size_t Font = fonts ? fonts->Find(c) : 0;
+	return (Font < faces.size() && faces[Font]) ? faces[Font] : face;
+}
@@ -0,0 +1,68 @@
+#include "FontSet.hpp"
+#include <iostream>
+#include <ft2build.h>
+#include FT_FREETYPE_H
+
+FontSet::FontSet() :
+	blockIndex(NumCodepoints >> BlockShift, 0),
+	blocks(BlockMask + 1, (uint8_t)NoFont)
+{
+}
+
+bool FontSet::Add(const void* buffer, size_t size) {
+	if (fonts.size() >= MaxFonts) {
+		return false;
+	}
+
+	FT_Library library;
+	FT_Face face;
+
+	if (FT_Init_FreeType(&library) != 0) {
+		std::cout << "Cannot initialize FreeType.\n";
+		return false;
+	}
+
+	if (FT_New_Memory_Face(library, (const FT_Byte*)buffer, (FT_Long)size, 0, &face) != 0) {
+		std::cout << "Cannot open font.\n";
+		FT_Done_FreeType(library);
+		return false;
+	}
+
+	const uint8_t Font = (uint8_t)fonts.size();
+	FT_UInt index;
+
+	// Walks the font's character map, codepoints an earlier font already
+	// has stay with it
+	for (FT_ULong c = FT_Get_First_Char(face, &index); index != 0; c = FT_Get_Next_Char(face, c, &index)) {
+		if (c >= NumCodepoints) {
+			break;
+		}
+
+		uint16_t& block = blockIndex[c >> BlockShift];
+
+		if (block == 0) {
+			block = (uint16_t)(blocks.size() >> BlockShift);
+			blocks.resize(blocks.size() + BlockMask + 1, (uint8_t)NoFont);
+		}
+
+		uint8_t& entry = blocks[(size_t)block << BlockShift | (c & BlockMask)];
+
+		if (entry == NoFont) {
+			entry = Font;
+		}
+	}
+
+	FT_Done_Face(face);
+	FT_Done_FreeType(library);
+
+	FontSource source;
+	source.buffer = buffer;
+	source.size = size;
+	fonts.push_back(source);
+
+	return true;
+}
+
+bool FontSet::Covers(uint32_t c) const {
+	return c < NumCodepoints && blocks[(size_t)blockIndex[c >> BlockShift] << BlockShift | (c & BlockMask)] != NoFont;
+}
@@ -0,0 +1,278 @@
+#include "GlyphAtlas.hpp"
+#include <algorithm>
+#include <climits>
+#include <cstring>
+
+// Partial-width regions taller than this are uploaded a few rows at a time
+static const size_t UploadScratchSize = 64 * 1024;
+
+// Returns the smallest rectangle containing both a and b
+static SDL_Rect UnionRect(const SDL_Rect& a, const SDL_Rect& b) {
+	SDL_Rect r;
+	r.x = std::min(a.x, b.x);
+	r.y = std::min(a.y, b.y);
+	r.w = std::max(a.x + a.w, b.x + b.w) - r.x;
+	r.h = std::max(a.y + a.h, b.y + b.h) - r.y;
+	return r;
+}
+
+// True when the rectangles overlap or share an edge
+static bool RectsTouch(const SDL_Rect& a, const SDL_Rect& b) {
+	return a.x <= b.x + b.w && b.x <= a.x + a.w &&
+		a.y <= b.y + b.h && b.y <= a.y + a.h;
+}
+
+// Halves the longer side of a page until one fits in the memory budget,
+// then limits the page count to what the budget has room for
+static GlyphAtlasDesc ApplyMemoryBudget(GlyphAtlasDesc desc) {
+	const size_t Bpp = GetTextureFormatSize(desc.format);
+
+	if (desc.memoryBudget == 0) {
+		return desc;
+	}
+
+	while (desc.width * desc.height * Bpp > desc.memoryBudget && desc.width > 1 && desc.height > 1) {
+		if (desc.width >= desc.height) {
+			desc.width /= 2;
+		}
+		else {
+			desc.height /= 2;
+		}
+	}
+
+	desc.maxPages = std::max<size_t>(1, std::min(desc.maxPages, desc.memoryBudget / (desc.width * desc.height * Bpp)));
+	return desc;
+}
+
+GlyphAtlasPage::GlyphAtlasPage(const GlyphAtlasDesc& desc) :
+	texture({}),
+	packer(nullptr),
+	pixels(nullptr),
+	numDirtyRects(0)
+{
+	const size_t Size = desc.width * desc.height * GetTextureFormatSize(desc.format);
+
+	pixels = new uint8_t[Size];
+	memset(pixels, 0, Size);
+	packer = CreateAtlasPacker(desc.packer, (uint16_t)desc.width, (uint16_t)desc.height);
+
+	TextureDesc td = {};
+	td.width = desc.width;
+	td.height = desc.height;
+	td.format = desc.format;
+
+	// Start from the cleared pixels, later uploads only touch dirty regions
+	texture = CreateGraphicsTexture(td, pixels);
+}
+
+GlyphAtlasPage::~GlyphAtlasPage() {
+	glDeleteTextures(1, &texture.textureHandle);
+	delete[] pixels;
+	delete packer;
+}
+
+void GlyphAtlasPage::MarkDirty(const SDL_Rect& rect) {
+	SDL_Rect r = rect;
+
+	// Fold the new region into any region it touches. A merge can make the
+	// result touch another region, so keep going until nothing changes.
+	bool merged = true;
+	while (merged) {
+		merged = false;
+		for (size_t i = 0; i < numDirtyRects; i++) {
+			if (RectsTouch(r, dirtyRects[i])) {
+				r = UnionRect(r, dirtyRects[i]);
+				dirtyRects[i] = dirtyRects[--numDirtyRects];
+				merged = true;
+				break;
+			}
+		}
+	}
+
+	if (numDirtyRects < MaxDirtyRects) {
+		dirtyRects[numDirtyRects++] = r;
+		return;
+	}
+
+	// Out of slots, grow whichever region takes the least extra area
+	size_t best = 0;
+	int bestGrowth = INT_MAX;
+	for (size_t i = 0; i < numDirtyRects; i++) {
+		SDL_Rect u = UnionRect(r, dirtyRects[i]);
+		int growth = u.w * u.h - dirtyRects[i].w * dirtyRects[i].h;
+		if (growth < bestGrowth) {
+			bestGrowth = growth;
+			best = i;
+		}
+	}
+	dirtyRects[best] = UnionRect(r, dirtyRects[best]);
+}
+
+GlyphAtlas::GlyphAtlas(const GlyphAtlasDesc& atlasDesc) :
+	desc(ApplyMemoryBudget(atlasDesc)),
+	pitch(0),
+	bytesPerPixel(GetTextureFormatSize(atlasDesc.format)),
+	uploadScratch(nullptr),
+	uploadScratchSize(0)
+{
+	if (desc.maxPages > MaxPages) {
+		desc.maxPages = MaxPages;
+	}
+
+	pitch = desc.width * bytesPerPixel;
+	uploadScratchSize = std::max(UploadScratchSize, pitch);
+	uploadScratch = new uint8_t[uploadScratchSize];
+
+	// There's always at least one page to draw from
+	pages.push_back(new GlyphAtlasPage(desc));
+}
+
+GlyphAtlas::~GlyphAtlas() {
+	for (GlyphAtlasPage* page : pages) {
+		delete page;
+	}
+	delete[] uploadScratch;
+}
+
+bool GlyphAtlas::Allocate(uint16_t w, uint16_t h, AtlasRect& out, uint16_t& page) {
+	for (size_t i = 0; i < pages.size(); i++) {
+		if (pages[i]->packer->Pack(w, h, out)) {
+			page = (uint16_t)i;
+			return true;
+		}
+	}
+
+	if (!AddPage()) {
+		return false;
+	}
+
+	// Too big for an empty page, don't keep a page nothing will use
+	if (!pages.back()->packer->Pack(w, h, out)) {
+		delete pages.back();
+		pages.pop_back();
+		return false;
+	}
+
+	page = (uint16_t)(pages.size() - 1);
+	return true;
+}
+
+bool GlyphAtlas::AddPage() {
+	if (pages.size() >= desc.maxPages) {
+		return false;
+	}
+
+	pages.push_back(new GlyphAtlasPage(desc));
+	return true;
+}
+
+void GlyphAtlas::WriteCoverage(uint16_t page, uint16_t x, uint16_t y, uint16_t w, uint16_t h, const uint8_t* src, ptrdiff_t srcPitch, size_t srcStride) {
+	SDL_Rect r = { x, y, w, h };
+
+	// Clip against the page instead of writing past it
+	r.w = std::min(r.w, (int)desc.width - r.x);
+	r.h = std::min(r.h, (int)desc.height - r.y);
+
+	if (r.w <= 0 || r.h <= 0) {
+		return;
+	}
+
+	uint8_t* pixels = pages[page]->pixels;
+
+	for (int row = 0; row < r.h; row++) {
+		const uint8_t* s = src + srcPitch * row;
+		uint8_t* d = pixels + pitch * (r.y + row) + bytesPerPixel * r.x;
+
+		if (desc.format == TextureFormat::Alpha8) {
+			for (int i = 0; i < r.w; i++) {
+				d[i] = s[srcStride * i];
+			}
+		}
+		else {
+			// White texels with the coverage as alpha so the vertex color
+			// comes through untouched
+			for (int i = 0; i < r.w; i++) {
+				d[0] = 0xFF;
+				d[1] = 0xFF;
+				d[2] = 0xFF;
+				d[3] = s[srcStride * i];
+				d += 4;
+			}
+		}
+	}
+
+	pages[page]->MarkDirty(r);
+}
+
+void GlyphAtlas::Clear(uint16_t page, const AtlasRect& rect) {
+	uint8_t* pixels = pages[page]->pixels;
+
+	for (uint16_t row = 0; row < rect.h; row++) {
+		memset(pixels + pitch * (rect.y + row) + bytesPerPixel * rect.x, 0, bytesPerPixel * rect.w);
+	}
+
+	MarkDirty(page, rect);
+}
+
+uint8_t* GlyphAtlas::GetTexel(uint16_t page, uint16_t x, uint16_t y) {
+	return pages[page]->pixels + pitch * y + bytesPerPixel * x;
+}
+
+void GlyphAtlas::MarkDirty(uint16_t page, const AtlasRect& rect) {
+	if (rect.w > 0 && rect.h > 0) {
+		SDL_Rect r = { rect.x, rect.y, rect.w, rect.h };
+		pages[page]->MarkDirty(r);
+	}
+}
+
+void GlyphAtlas::Upload() {
+	uploadStats.bytesUploaded = 0;
+	uploadStats.numUploads = 0;
+
+	for (GlyphAtlasPage* page : pages) {
+		// Pages without new glyphs are skipped entirely
+		for (size_t i = 0; i < page->numDirtyRects; i++) {
+			const SDL_Rect& r = page->dirtyRects[i];
+			const uint8_t* src = page->pixels + pitch * r.y + bytesPerPixel * r.x;
+			const size_t RowSize = bytesPerPixel * r.w;
+
+			uploadStats.bytesUploaded += RowSize * r.h;
+
+			if (RowSize == pitch) {
+				UpdateGraphicsTexture(page->texture, r.x, r.y, r.w, r.h, src);
+				uploadStats.numUploads++;
+				continue;
+			}
+
+			// GLES2 has no GL_UNPACK_ROW_LENGTH, so partial-width regions
+			// get packed tightly into the scratchpad first, as many rows
+			// at a time as it holds
+			const int RowsPerUpload = (int)(uploadScratchSize / RowSize);
+
+			for (int row = 0; row < r.h; row += RowsPerUpload) {
+				const int NumRows = std::min(RowsPerUpload, r.h - row);
+
+				for (int i = 0; i < NumRows; i++) {
+					memcpy(uploadScratch + RowSize * i, src + pitch * (row + i), RowSize);
+				}
+
+				UpdateGraphicsTexture(page->texture, r.x, r.y + row, r.w, NumRows, uploadScratch);
+				uploadStats.numUploads++;
+			}
+		}
+
+		page->numDirtyRects = 0;
+	}
+
+	uploadStats.totalBytesUploaded += uploadStats.bytesUploaded;
+}
+
+float GlyphAtlas::Occupancy() const {
+	size_t used = 0;
+
+	for (const GlyphAtlasPage* page : pages) {
+		used += page->packer->usedArea;
+	}
+
+	return (float)used / ((float)desc.width * desc.height * pages.size());
+}
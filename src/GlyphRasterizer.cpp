@@ -0,0 +1,254 @@
+#include "GlyphRasterizer.hpp"
+#include <iostream>
+#include <algorithm>
+#include FT_OUTLINE_H
+
+GlyphRasterizer::GlyphRasterizer(const FontSet& fonts, size_t fontSize, uint16_t spread, FontStyle style, uint8_t subpixelPositions) :
+	fonts(fonts),
+	library(nullptr),
+	face(nullptr),
+	loaded(nullptr),
+	spread(spread),
+	descender(0),
+	style(style),
+	emboldenStrength(0),
+	subpixelPositions(subpixelPositions),
+	loadFlags(FT_LOAD_NO_BITMAP),
+	coverageW(0),
+	coverageH(0)
+{
+	// Full hinting snaps stems to the pixel grid, which a glyph shifted
+	// by part of a pixel is off of
+	if (subpixelPositions > 1) {
+		loadFlags |= FT_LOAD_TARGET_LIGHT;
+	}
+
+	if (FT_Init_FreeType(&library) != 0) {
+		std::cout << "Cannot initialize FreeType.\n";
+		return;
+	}
+
+	// Every font is drawn at the same size, fallbacks sit on the first
+	// font's lines
+	for (const FontSource& source : fonts.fonts) {
+		FT_Face fontFace = nullptr;
+
+		if (FT_New_Memory_Face(library, (const FT_Byte*)source.buffer, (FT_Long)source.size, 0, &fontFace) != 0) {
+			std::cout << "Cannot open font.\n";
+			fontFace = nullptr;
+		}
+		else {
+			FT_Set_Pixel_Sizes(fontFace, 0, (FT_UInt)fontSize);
+		}
+
+		faces.push_back(fontFace);
+	}
+
+	if (faces.empty() || !faces[0]) {
+		return;
+	}
+
+	face = faces[0];
+	descender = (int)(face->size->metrics.descender >> 6);
+
+	// A 24th of the em like FT_GlyphSlot_Embolden, rounded to whole
+	// pixels so advances stay whole too
+	if ((int)style & (int)FontStyle::Bold) {
+		emboldenStrength = std::max<FT_Pos>(64, ((FT_Pos)fontSize * 64 / 24 + 32) & ~63);
+	}
+}
+
+GlyphRasterizer::~GlyphRasterizer() {
+	for (FT_Face fontFace : faces) {
+		if (fontFace) {
+			FT_Done_Face(fontFace);
+		}
+	}
+
+	if (library) {
+		FT_Done_FreeType(library);
+	}
+}
+
+FT_Face GlyphRasterizer::FindFace(uint32_t c) const {
+	c &= ~GlyphVariantMask;
+
+	const size_t Font = (c & GlyphIndexBit) ? (c & ~GlyphIndexBit) >> GlyphFontShift : fonts.Find(c);
+	return (Font < faces.size() && faces[Font]) ? faces[Font] : face;
+}
+
+bool GlyphRasterizer::Load(uint32_t c, GlyphBitmap& out) {
+	loaded = FindFace(c);
+
+	if (!loaded) {
+		return false;
+	}
+
+	const FT_UInt Index = (c & GlyphIndexBit) ? (c & GlyphIndexMask) : FT_Get_Char_Index(loaded, c & ~GlyphVariantMask);
+
+	if (FT_Load_Glyph(loaded, Index, loadFlags) != 0 ||
+		loaded->glyph->format != FT_GLYPH_FORMAT_OUTLINE) {
+		return false;
+	}
+
+	// Snap the outline's box out to whole pixels and move it to the
+	// origin, so rendering fills exactly coverageW * coverageH texels
+	FT_Outline* outline = &loaded->glyph->outline;
+	FT_BBox box;
+
+	// Slanted the way FreeType's own oblique is
+	if ((int)style & (int)FontStyle::Italic) {
+		FT_Matrix shear;
+		shear.xx = 0x10000;
+		shear.xy = 0x0366A;
+		shear.yx = 0;
+		shear.yy = 0x10000;
+		FT_Outline_Transform(outline, &shear);
+	}
+
+	if (emboldenStrength > 0) {
+		FT_Outline_Embolden(outline, emboldenStrength);
+	}
+
+	// Before snapping, so the phase shows up in the coverage and bearing
+	const uint8_t Phase = GetGlyphPhase(c);
+	if (Phase > 0 && Phase < subpixelPositions) {
+		FT_Outline_Translate(outline, (FT_Pos)Phase * 64 / subpixelPositions, 0);
+	}
+
+	FT_Outline_Get_CBox(outline, &box);
+	box.xMin &= ~63;
+	box.yMin &= ~63;
+	box.xMax = (box.xMax + 63) & ~63;
+	box.yMax = (box.yMax + 63) & ~63;
+	FT_Outline_Translate(outline, -box.xMin, -box.yMin);
+
+	coverageW = (uint16_t)((box.xMax - box.xMin) >> 6);
+	coverageH = (uint16_t)((box.yMax - box.yMin) >> 6);
+
+	out.codepoint = c;
+	out.w = coverageW + 2 * spread;
+	out.h = coverageH + 2 * spread;
+	out.spread = spread;
+
+	// The pen sits at the bottom of the line, below the descender
+	out.bearingX = (int16_t)((box.xMin >> 6) - spread);
+	out.bearingY = (int16_t)((box.yMin >> 6) - descender - spread);
+	out.advance = (uint16_t)((loaded->glyph->advance.x + emboldenStrength + 32) >> 6);
+
+	return true;
+}
+
+void GlyphRasterizer::Render(uint8_t* dst, ptrdiff_t pitch) {
+	if (coverageW == 0 || coverageH == 0) {
+		return;
+	}
+
+	FT_Bitmap bitmap = {};
+	bitmap.rows = coverageH;
+	bitmap.width = coverageW;
+	bitmap.pitch = (int)pitch;
+	bitmap.buffer = dst;
+	bitmap.num_grays = 256;
+	bitmap.pixel_mode = FT_PIXEL_MODE_GRAY;
+
+	FT_Outline_Get_Bitmap(library, &loaded->glyph->outline, &bitmap);
+}
+
+bool GlyphRasterizer::Rasterize(uint32_t c, GlyphBitmap& out) {
+	if (!Load(c, out)) {
+		return false;
+	}
+
+	// Both keep their capacity, so this only allocates while the
+	// largest glyph so far keeps growing
+	out.pixels.assign((size_t)out.w * out.h, 0);
+
+	if (spread == 0) {
+		Render(out.pixels.data(), -(ptrdiff_t)out.w);
+	}
+	else if (coverageW > 0 && coverageH > 0) {
+		coverage.assign((size_t)coverageW * coverageH, 0);
+		Render(coverage.data(), -(ptrdiff_t)coverageW);
+		distanceFieldGenerator.Generate(coverage.data(), coverageW, coverageH, coverageW, 1, spread, out.pixels.data());
+	}
+
+	return true;
+}
+
+AsyncGlyphRasterizer::AsyncGlyphRasterizer(const FontSet& fonts, size_t fontSize, uint16_t spread, FontStyle style, uint8_t subpixelPositions) :
+	rasterizer(fonts, fontSize, spread, style, subpixelPositions),
+	stop(false)
+{
+	thread = std::thread(&AsyncGlyphRasterizer::Run, this);
+}
+
+AsyncGlyphRasterizer::~AsyncGlyphRasterizer() {
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stop = true;
+	}
+
+	wake.notify_one();
+	thread.join();
+}
+
+void AsyncGlyphRasterizer::Request(uint32_t c) {
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+
+		if (failed.count(c) || !inFlight.insert(c).second) {
+			return;
+		}
+
+		requests.push_back(c);
+	}
+
+	wake.notify_one();
+}
+
+void AsyncGlyphRasterizer::Poll(std::vector<GlyphBitmap>& out) {
+	out.clear();
+
+	std::lock_guard<std::mutex> lock(mutex);
+
+	// The emptied vector goes back to the worker with its capacity
+	out.swap(finished);
+
+	for (const GlyphBitmap& bitmap : out) {
+		inFlight.erase(bitmap.codepoint);
+	}
+}
+
+void AsyncGlyphRasterizer::Run() {
+	GlyphBitmap bitmap;
+
+	for (;;) {
+		uint32_t c;
+
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			wake.wait(lock, [this] { return stop || !requests.empty(); });
+
+			if (stop) {
+				return;
+			}
+
+			c = requests.front();
+			requests.pop_front();
+		}
+
+		bool rasterized = rasterizer.Rasterize(c, bitmap);
+
+		std::lock_guard<std::mutex> lock(mutex);
+
+		if (rasterized) {
+			finished.push_back(std::move(bitmap));
+			bitmap = GlyphBitmap();
+		}
+		else {
+			inFlight.erase(c);
+			failed.insert(c);
+		}
+	}
+}
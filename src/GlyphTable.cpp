@@ -0,0 +1,153 @@
+#include "GlyphTable.hpp"
+
+static const size_t InitialSlots = 64;
+static const uint32_t InitialShift = 26;
+
+GlyphTable::GlyphTable() :
+	shift(InitialShift),
+	count(0),
+	hashedCount(0)
+{
+	Clear();
+}
+
+// Fibonacci hashing, the top bits of the product spread neighbouring
+// codepoints of a script all over the table
+size_t GlyphTable::Home(uint32_t c) const {
+	return (uint32_t)(c * 2654435769u) >> shift;
+}
+
+Glyph* GlyphTable::Find(uint32_t c) {
+	return const_cast<Glyph*>(static_cast<const GlyphTable*>(this)->Find(c));
+}
+
+const Glyph* GlyphTable::Find(uint32_t c) const {
+	if (c < DirectSize) {
+		return (direct[c].codepoint == c) ? &direct[c] : nullptr;
+	}
+
+	const size_t Mask = slots.size() - 1;
+
+	for (size_t i = Home(c); ; i = (i + 1) & Mask) {
+		if (slots[i].codepoint == c) {
+			return &slots[i];
+		}
+
+		if (slots[i].codepoint == NoCodepoint) {
+			return nullptr;
+		}
+	}
+}
+
+Glyph& GlyphTable::Insert(uint32_t c) {
+	if (c < DirectSize) {
+		if (direct[c].codepoint != c) {
+			direct[c] = Glyph();
+			direct[c].codepoint = c;
+			count++;
+		}
+
+		return direct[c];
+	}
+
+	// Kept at most half full so misses stop after a probe or two
+	if ((hashedCount + 1) * 2 > slots.size()) {
+		Grow();
+	}
+
+	const size_t Mask = slots.size() - 1;
+	size_t i = Home(c);
+
+	while (slots[i].codepoint != NoCodepoint) {
+		if (slots[i].codepoint == c) {
+			return slots[i];
+		}
+
+		i = (i + 1) & Mask;
+	}
+
+	slots[i] = Glyph();
+	slots[i].codepoint = c;
+	hashedCount++;
+	count++;
+
+	return slots[i];
+}
+
+void GlyphTable::Erase(uint32_t c) {
+	if (c < DirectSize) {
+		if (direct[c].codepoint == c) {
+			direct[c].codepoint = NoCodepoint;
+			count--;
+		}
+
+		return;
+	}
+
+	const size_t Mask = slots.size() - 1;
+	size_t hole = Home(c);
+
+	while (slots[hole].codepoint != c) {
+		if (slots[hole].codepoint == NoCodepoint) {
+			return;
+		}
+
+		hole = (hole + 1) & Mask;
+	}
+
+	// Shift later entries of the probe run back into the hole instead of
+	// leaving a tombstone, so lookups never walk over deleted slots. An
+	// entry may move when the hole lies between its home and where it is.
+	for (size_t i = (hole + 1) & Mask; slots[i].codepoint != NoCodepoint; i = (i + 1) & Mask) {
+		const size_t Ideal = Home(slots[i].codepoint);
+
+		if (((i - Ideal) & Mask) >= ((i - hole) & Mask)) {
+			slots[hole] = slots[i];
+			hole = i;
+		}
+	}
+
+	slots[hole].codepoint = NoCodepoint;
+	hashedCount--;
+	count--;
+}
+
+void GlyphTable::Clear() {
+	for (size_t i = 0; i < DirectSize; i++) {
+		direct[i].codepoint = NoCodepoint;
+	}
+
+	Glyph empty;
+	empty.codepoint = NoCodepoint;
+
+	slots.assign(InitialSlots, empty);
+	shift = InitialShift;
+	count = 0;
+	hashedCount = 0;
+}
+
+void GlyphTable::Grow() {
+	std::vector<Glyph> old;
+	Glyph empty;
+	empty.codepoint = NoCodepoint;
+
+	old.swap(slots);
+	slots.assign(old.size() * 2, empty);
+	shift--;
+
+	const size_t Mask = slots.size() - 1;
+
+	for (const Glyph& glyph : old) {
+		if (glyph.codepoint == NoCodepoint) {
+			continue;
+		}
+
+		size_t i = Home(glyph.codepoint);
+
+		while (slots[i].codepoint != NoCodepoint) {
+			i = (i + 1) & Mask;
+		}
+
+		slots[i] = glyph;
+	}
+}
@@ -2,10 +2,13 @@
 #include <string.h>
 #include <chrono>
 #include <vector>
+#include <string>
+#include <algorithm>
 
 #include "Utility.hpp"
 #include "SpriteRenderer.hpp"
 #include "TextRenderer.hpp"
+#include "Unicode.hpp"
 
 /* Wrapper because *technically* the glad function isn't expecting a _cdecl function */
 // This is for the Windows port
@@ -42,6 +45,161 @@ void FrameStatistics::Update(float delta) {
 	}
 }
 
+// Packs the boxes of every glyph of faces over range into an empty
+// 1024x1024 page with each packer, cycling through them until one doesn't
+// fit. Glyphs are only loaded for their size, nothing is rasterized.
+static void RunPackerBenchmark(TextRenderer& textRenderer, const char* name, const uint8_t* faces, size_t numFaces, CodepointRange range) {
+	std::vector<AtlasRect> boxes;
+	GlyphBitmap bitmap;
+
+	for (size_t i = 0; i < numFaces; i++) {
+		GlyphRasterizer& rasterizer = textRenderer.GetFace(faces[i]).rasterizer;
+
+		for (uint32_t c = range.first; c <= range.last; c++) {
+			if (rasterizer.Load(c, bitmap) && bitmap.w > 0 && bitmap.h > 0) {
+				AtlasRect box;
+				box.w = bitmap.w;
+				box.h = bitmap.h;
+				boxes.push_back(box);
+			}
+		}
+	}
+
+	if (boxes.empty()) {
+		return;
+	}
+
+	const AtlasPackerType Types[] = { AtlasPackerType::Skyline, AtlasPackerType::MaxRects };
+	const char* TypeNames[] = { "skyline", "MaxRects" };
+	const uint16_t PageSize = 1024;
+
+	for (size_t i = 0; i < 2; i++) {
+		AtlasPacker* packer = CreateAtlasPacker(Types[i], PageSize, PageSize);
+		AtlasRect out;
+		size_t packed = 0;
+
+		auto start = std::chrono::high_resolution_clock::now();
+
+		while (packer->Pack(boxes[packed % boxes.size()].w, boxes[packed % boxes.size()].h, out)) {
+			packed++;
+		}
+
+		auto end = std::chrono::high_resolution_clock::now();
+		const double Seconds = std::chrono::duration<double>(end - start).count();
+
+		std::cout << name << ", " << TypeNames[i] << ": " << packed << " glyphs, "
+			<< packer->Occupancy() * 100 << "% occupied, "
+			<< Seconds * 1e9 / (packed + 1) << " ns/glyph\n";
+
+		delete packer;
+	}
+}
+
+// Times how fast WriteString turns cached glyphs into quads, with the
+// layout cache off so every pass runs the emission loop, and then how
+// fast the same string replays from the layout cache. Then how fast
+// MeasureString lays out the same text, and drawing a screen of short
+// labels one WriteString at a time against one WriteStrings batch.
+// Nothing is drawn, the sprites are discarded after every pass.
+static void RunBenchmark(TextRenderer& textRenderer, SpriteRenderer& spriteRenderer) {
+	const size_t NumPasses = 2000;
+	const size_t LineLength = 64;
+	const size_t TextLength = 4096;
+	std::string text;
+
+	// Cycles through printable ASCII so every glyph is already cached
+	for (size_t i = 0; text.size() < TextLength; i++) {
+		text += (i % LineLength == LineLength - 1) ? '\n' : (char)(' ' + i % 95);
+	}
+
+	const double NumGlyphs = (double)NumPasses * text.size();
+	const size_t LayoutCapacity = textRenderer.layoutCapacity;
+	const char* WriteNames[] = { "WriteString", "WriteString, layout cache replay" };
+	std::chrono::high_resolution_clock::time_point start, end;
+
+	for (size_t pass = 0; pass < 2; pass++) {
+		// Without a capacity the layout cache is skipped altogether
+		textRenderer.layoutCapacity = (pass == 0) ? 0 : LayoutCapacity;
+
+		textRenderer.WriteString(Math::Vector2f(), Math::Vector3f(1, 1, 1), text.data(), text.size());
+		spriteRenderer.Discard();
+
+		start = std::chrono::high_resolution_clock::now();
+
+		for (size_t i = 0; i < NumPasses; i++) {
+			textRenderer.WriteString(Math::Vector2f(), Math::Vector3f(1, 1, 1), text.data(), text.size());
+			spriteRenderer.Discard();
+		}
+
+		end = std::chrono::high_resolution_clock::now();
+		const double Seconds = std::chrono::duration<double>(end - start).count();
+
+		std::cout << WriteNames[pass] << ": " << NumGlyphs / Seconds / 1e6 << " M glyphs/s, "
+			<< Seconds * 1e9 / NumGlyphs << " ns/glyph\n";
+	}
+
+	std::vector<Math::Vector2f> carets(text.size() + 1);
+	TextExtents extents;
+
+	start = std::chrono::high_resolution_clock::now();
+
+	for (size_t i = 0; i < NumPasses; i++) {
+		textRenderer.MeasureString(text.data(), text.size(), extents, carets.data(), carets.size());
+	}
+
+	end = std::chrono::high_resolution_clock::now();
+	const double MeasureSeconds = std::chrono::duration<double>(end - start).count();
+
+	std::cout << "MeasureString: " << NumGlyphs / MeasureSeconds / 1e6 << " M glyphs/s, "
+		<< MeasureSeconds * 1e9 / NumGlyphs << " ns/glyph, "
+		<< extents.width << " x " << extents.height << "\n";
+
+	// More labels than the layout cache holds, like a busy dashboard
+	const size_t NumLabels = 500;
+	std::vector<std::string> labels(NumLabels);
+	std::vector<TextRun> runs(NumLabels);
+
+	for (size_t i = 0; i < NumLabels; i++) {
+		labels[i] = "Value " + std::to_string(i * 37 % 1000);
+
+		runs[i].text = labels[i].data();
+		runs[i].length = labels[i].size();
+		runs[i].position = Math::Vector2f((float)(i % 5) * 100 - 250, (float)(i / 5) * 5 - 250);
+	}
+
+	size_t numLabelGlyphs = 0;
+	for (const std::string& label : labels) {
+		numLabelGlyphs += label.size();
+	}
+
+	start = std::chrono::high_resolution_clock::now();
+
+	for (size_t i = 0; i < NumPasses; i++) {
+		for (const TextRun& run : runs) {
+			textRenderer.WriteString(run.position, run.color, run.text, run.length);
+		}
+		spriteRenderer.Discard();
+	}
+
+	end = std::chrono::high_resolution_clock::now();
+	const double SingleSeconds = std::chrono::duration<double>(end - start).count();
+
+	start = std::chrono::high_resolution_clock::now();
+
+	for (size_t i = 0; i < NumPasses; i++) {
+		textRenderer.WriteStrings(runs.data(), runs.size());
+		spriteRenderer.Discard();
+	}
+
+	end = std::chrono::high_resolution_clock::now();
+	const double BatchSeconds = std::chrono::duration<double>(end - start).count();
+	const double NumLabelPasses = (double)NumPasses * NumLabels;
+
+	std::cout << NumLabels << " labels, " << numLabelGlyphs << " glyphs: WriteString "
+		<< SingleSeconds * 1e9 / NumLabelPasses << " ns/label, WriteStrings "
+		<< BatchSeconds * 1e9 / NumLabelPasses << " ns/label\n";
+}
+
 int main(int argc, char** argv) {
 	int result;
 
@@ -51,13 +209,6 @@ int main(int argc, char** argv) {
 		std::cout << "Cannot initialize SDL.\n";
 		exit(EXIT_FAILURE);
 	}
-	 
-	result = TTF_Init();
-
-	if (result < 0) {
-		std::cout << "Cannot initialize SDL TTF.\n";
-		exit(EXIT_FAILURE);
-	}
 
 	RenderContextDesc rcDesc = {};
 	RenderContext renderContext;
@@ -77,11 +228,22 @@ int main(int argc, char** argv) {
 	// Load our resources
 	const size_t MaxSprites = 1024 * 8;
 	std::vector<uint8_t> fb;
+	std::vector<uint8_t> cjkBuffer; // Only loaded for --benchmark
 
 	Utility::LoadFile("assets/font/Hack-Regular.ttf", fb);
 	SpriteRenderer spriteRenderer(renderContext, MaxSprites);
 	TextRenderer textRenderer(spriteRenderer, 20, fb.data(), fb.size());
 
+	// Smaller text for the frame rate, drawn from the same atlas
+	FontFaceDesc captionDesc;
+	captionDesc.fontBuffer = fb.data();
+	captionDesc.fontBufferSize = fb.size();
+	captionDesc.fontSize = 14;
+	captionDesc.subpixelPositions = 4; // Small text shows uneven spacing the most
+
+	uint8_t captionFace = 0;
+	textRenderer.AddFace(captionDesc, captionFace);
+
 
 	// Set up our matrices
 	Math::Matrix4x4f pm, vm, mvp;
@@ -90,8 +252,6 @@ int main(int argc, char** argv) {
 	Math::Identity(mvp);
 
 	Math::BuildOrthoMatrix(pm, (float)rcDesc.width, (float)rcDesc.height, 1.0f, -100.0f);
-	
-	GLint u_mvp = glGetUniformLocation(spriteRenderer.program, "u_mvp");
 
 	// Buffer to hold a copy of our render calls
 	std::vector<RenderCall> calls(MaxSprites);
@@ -101,18 +261,77 @@ int main(int argc, char** argv) {
 	auto startTime = std::chrono::high_resolution_clock::now();
 	float deltaTime = 0;
 
-	// EXAMPLE: Warm up the text renderer
-	/*for (size_t i = 'A'; i < 'z'; i++) {
-		textRenderer.AddCharacter(i);
-	}*/
+	// Warm up the text renderer with printable ASCII, unless a previous
+	// run left its glyphs behind
+	const char* GlyphCachePath = "glyph-cache.bin";
+
+	if (!textRenderer.LoadCache(GlyphCachePath)) {
+		const CodepointRange PrewarmRanges[] = { { ' ', '~' } };
+		textRenderer.Prewarm(PrewarmRanges, 1);
+		textRenderer.SaveCache(GlyphCachePath);
+	}
+
+	if (argc > 1 && strcmp(argv[1], "--benchmark") == 0) {
+		RunBenchmark(textRenderer, spriteRenderer);
+
+		// Latin at a spread of UI sizes, and CJK at the text size when a
+		// font with it is passed after --benchmark
+		const size_t LatinSizes[] = { 12, 16, 24, 32, 48 };
+		std::vector<uint8_t> latinFaces = { 0, captionFace };
+
+		for (size_t size : LatinSizes) {
+			FontFaceDesc faceDesc;
+			faceDesc.fontBuffer = fb.data();
+			faceDesc.fontBufferSize = fb.size();
+			faceDesc.fontSize = size;
+
+			uint8_t id;
+			if (textRenderer.AddFace(faceDesc, id)) {
+				latinFaces.push_back(id);
+			}
+		}
+
+		RunPackerBenchmark(textRenderer, "Latin", latinFaces.data(), latinFaces.size(), { ' ', '~' });
+
+		if (argc > 2) {
+			Utility::LoadFile(argv[2], cjkBuffer);
+		}
+
+		if (!cjkBuffer.empty()) {
+			FontFaceDesc faceDesc;
+			faceDesc.fontBuffer = cjkBuffer.data();
+			faceDesc.fontBufferSize = cjkBuffer.size();
+			faceDesc.fontSize = 20;
+
+			uint8_t id;
+			if (textRenderer.AddFace(faceDesc, id)) {
+				RunPackerBenchmark(textRenderer, "CJK", &id, 1, { 0x4E00, 0x9FFF });
+			}
+		}
+
+		running = false;
+	}
+
+	// Shows a file instead of the demo text, for looking at large logs
+	Document document;
+	bool viewing = false;
+	double scrollY = 0; // A float can't step through millions of lines a pixel at a time
+
+	if (argc > 2 && strcmp(argv[1], "--view") == 0) {
+		viewing = document.Open(argv[2]);
+
+		if (!viewing) {
+			std::cout << "Cannot open " << argv[2] << ".\n";
+		}
+	}
 	
 	UiState uiState;
 	FrameStatistics frameStats = {};
 
 	const char* GreetingMessage =
-		"Welcome to this OpenGL ES text\n"
-		"rendering example. Uses SDL2\n"
-		"and SDL2 TTF.";
+		"Welcome to this OpenGL ES text "
+		"rendering example. Uses SDL2 "
+		"and FreeType.";
 	const char* ControlsMessage =
 		"       *CONTROLS*\n"
 		"Show Greeting: 'M'\n"
@@ -121,6 +340,20 @@ int main(int argc, char** argv) {
 		"Show Controls: 'C'\n"
 		"Show Transparency: 'A'\n";
 
+	// The greeting is wrapped to fit instead of broken by hand
+	ParagraphDesc greetingDesc;
+	greetingDesc.wrapWidth = 320;
+	greetingDesc.align = TextAlign::Center;
+
+	Paragraph greeting(textRenderer.GetFace(), greetingDesc);
+	std::vector<uint32_t> greetingText(strlen(GreetingMessage));
+	greetingText.resize(Unicode::DecodeUtf8(GreetingMessage, greetingText.size(), greetingText.data()));
+	greeting.SetText(greetingText.data(), greetingText.size());
+
+	// The controls never change, so they're laid out once into their own buffers
+	TextBlock controlsBlock;
+	textRenderer.SetText(controlsBlock, ControlsMessage, strlen(ControlsMessage));
+
 	char fpsBuffer[256] = { 0 };
 
 	// Default state
@@ -128,7 +361,9 @@ int main(int argc, char** argv) {
 	uiState.showCacheTexture = true;
 	uiState.showFps = true;
 	uiState.showTransparency = true;
-	uiState.showControls = true;
+	uiState.showControls = !viewing;
+	uiState.showMessage = !viewing;
+	uiState.showCacheTexture = !viewing;
 
 	while (running) {
 		SDL_Event event = {};
@@ -154,6 +389,24 @@ int main(int argc, char** argv) {
 				case SDLK_a:
 					uiState.showTransparency = !uiState.showTransparency;
 					break;
+				case SDLK_UP:
+					scrollY -= textRenderer.GetFace().metrics.lineHeight;
+					break;
+				case SDLK_DOWN:
+					scrollY += textRenderer.GetFace().metrics.lineHeight;
+					break;
+				case SDLK_PAGEUP:
+					scrollY -= rcDesc.height;
+					break;
+				case SDLK_PAGEDOWN:
+					scrollY += rcDesc.height;
+					break;
+				case SDLK_HOME:
+					scrollY = 0;
+					break;
+				case SDLK_END:
+					scrollY = (double)document.NumLines() * textRenderer.GetFace().metrics.lineHeight;
+					break;
 				default:
 					break;
 				}
@@ -166,22 +419,26 @@ int main(int argc, char** argv) {
 		frameStats.Update(deltaTime);
 
 		mvp = pm * vm;
-		glUseProgram(spriteRenderer.program);
-		glUniformMatrix4fv(u_mvp, 1, GL_FALSE, (const float*)& mvp);
+		spriteRenderer.SetTransform(mvp);
 
 		glClear(GL_COLOR_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
 		
 		float avgFps = frameStats.average;
 		sprintf(fpsBuffer, "%.2f", avgFps);
 
+		// Applied per render call by SubmitRenderCalls
+		spriteRenderer.SetBlendMode(uiState.showTransparency ? BlendMode::Alpha : BlendMode::Opaque);
+
 		// Draw our strings with the text renderer
 		if (uiState.showFps) {
+			textRenderer.SetFace(captionFace);
 			textRenderer.WriteString(
 				Math::Vector2f(120, 220),
 				Math::Vector3f(1, 1, 0),
 				fpsBuffer,
 				strlen(fpsBuffer)
 			);
+			textRenderer.SetFace(0);
 		}
 
 		if (uiState.showCacheTexture) {
@@ -198,7 +455,7 @@ int main(int argc, char** argv) {
 			dst.w = 128;
 
 			spriteRenderer.PushSprite(
-				textRenderer.cacheTexture,
+				textRenderer.atlas.pages[0]->texture,
 				src,
 				dst,
 				Math::Vector3f(1, 1, 1)
@@ -206,29 +463,41 @@ int main(int argc, char** argv) {
 		}
 
 		if (uiState.showMessage) {
-			textRenderer.WriteString(
+			textRenderer.DrawParagraph(
+				greeting,
 				Math::Vector2f(-175, -40),
-				Math::Vector3f(1, 1, 1),
-				GreetingMessage,
-				strlen(GreetingMessage)
+				Math::Vector3f(1, 1, 1)
 			);
 		}
 
 		if (uiState.showControls) {
-			textRenderer.WriteString(
+			textRenderer.DrawTextBlock(
+				controlsBlock,
 				Math::Vector2f(-220, 125),
-				Math::Vector3f(.5, .75, 0),
-				ControlsMessage,
-				strlen(ControlsMessage)
+				Math::Vector3f(.5, .75, 0)
 			);
 		}
 
-		if (uiState.showTransparency) {
-			glEnable(GL_BLEND);
-			glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-		}
-		else {
-			glDisable(GL_BLEND);
+		if (viewing) {
+			// Index the file a slice at a time for a couple of milliseconds a
+			// frame, pages of the file faulting in make the bytes per
+			// millisecond vary too much for a fixed amount
+			const auto IndexStart = std::chrono::high_resolution_clock::now();
+			const std::chrono::microseconds IndexBudget(2000);
+
+			while (!document.IndexLines(256 * 1024) && std::chrono::high_resolution_clock::now() - IndexStart < IndexBudget) {
+			}
+
+			const double MaxScroll = (double)document.NumLines() * textRenderer.GetFace().metrics.lineHeight - rcDesc.height;
+			scrollY = std::max(0.0, std::min(scrollY, MaxScroll));
+
+			textRenderer.DrawDocument(
+				document,
+				Math::Vector2f(-(float)rcDesc.width / 2, (float)rcDesc.height / 2),
+				Math::Vector3f(1, 1, 1),
+				scrollY,
+				(float)rcDesc.height
+			);
 		}
 
 		// Build our command list based off of our previous commands
@@ -248,7 +517,6 @@ int main(int argc, char** argv) {
 	
 	DestroyRenderContext(renderContext);
 
-	TTF_Quit();
 	SDL_Quit();
 
 	return 0;
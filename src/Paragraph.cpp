@@ -0,0 +1,264 @@
+#include "Paragraph.hpp"
+#include <algorithm>
+#include <iterator>
+#include <cmath>
+
+static bool IsSpace(uint32_t c) {
+	return c == ' ' || c == '\t';
+}
+
+Paragraph::Paragraph(FontFace& face, const ParagraphDesc& desc) :
+	face(face),
+	shaper(face.shaper),
+	metrics(face.metrics),
+	desc(desc),
+	tabWidth(0),
+	maxWidth(0)
+{
+	SetTabWidth(desc.tabWidth);
+}
+
+void Paragraph::SetText(const uint32_t* text, size_t length) {
+	Replace(0, this->text.size(), text, length);
+}
+
+void Paragraph::Replace(size_t at, size_t removed, const uint32_t* inserted, size_t count) {
+	at = std::min(at, text.size());
+	removed = std::min(removed, text.size() - at);
+
+	// Taking text off the start of a line can make its first word fit on
+	// the line before, so start there unless a '\n' is in between
+	size_t first = FindLine(at);
+	if (first > 0 && !lines[first - 1].hardBreak) {
+		first--;
+	}
+
+	text.erase(text.begin() + at, text.begin() + at + removed);
+	text.insert(text.begin() + at, inserted, inserted + count);
+
+	LayoutLines(first, at + count, (ptrdiff_t)count - (ptrdiff_t)removed);
+}
+
+void Paragraph::Insert(size_t at, const uint32_t* inserted, size_t count) {
+	Replace(at, 0, inserted, count);
+}
+
+void Paragraph::Erase(size_t at, size_t count) {
+	Replace(at, count, nullptr, 0);
+}
+
+void Paragraph::SetWrapWidth(float wrapWidth) {
+	desc.wrapWidth = wrapWidth;
+	lines.clear();
+	LayoutLines(0, 0, 0);
+}
+
+void Paragraph::SetTabWidth(float tabWidth) {
+	desc.tabWidth = tabWidth;
+	this->tabWidth = (tabWidth > 0) ? tabWidth : 4.0f * metrics.GetAdvance(' ');
+
+	// A font without a space still needs tab stops that go somewhere
+	if (this->tabWidth <= 0) {
+		this->tabWidth = 1;
+	}
+
+	lines.clear();
+	LayoutLines(0, 0, 0);
+}
+
+void Paragraph::SetAlign(TextAlign align) {
+	desc.align = align;
+}
+
+size_t Paragraph::FindLine(size_t position) const {
+	auto it = std::upper_bound(lines.begin(), lines.end(), position,
+		[](size_t p, const ParagraphLine& line) { return p < line.start; });
+
+	return (it == lines.begin()) ? 0 : (size_t)(it - lines.begin()) - 1;
+}
+
+float Paragraph::GetLineOffset(const ParagraphLine& line) const {
+	const float BoxWidth = (desc.wrapWidth > 0) ? desc.wrapWidth : maxWidth;
+
+	switch (desc.align) {
+	case TextAlign::Center:
+		return std::floor((BoxWidth - line.width) * 0.5f);
+	case TextAlign::Right:
+		return BoxWidth - line.width;
+	case TextAlign::Left:
+	default:
+		return 0;
+	}
+}
+
+void Paragraph::LayoutLines(size_t first, size_t editEnd, ptrdiff_t delta) {
+	size_t start = (first < lines.size()) ? lines[first].start : 0;
+	size_t old = first;
+	size_t resume = lines.size();
+
+	newLines.clear();
+
+	for (;;) {
+		newLines.push_back(ParagraphLine());
+		ParagraphLine& line = newLines.back();
+
+		LayoutLine(start, line);
+		start = line.start + line.length + (line.hardBreak ? 1 : 0);
+
+		// Only a '\n' right at the end leaves an empty line after it
+		if (!line.hardBreak && start == text.size()) {
+			break;
+		}
+
+		// Past the edit, a line starting where an old one did is laid out
+		// the same as before, and so is everything after it
+		if (start >= editEnd) {
+			const size_t OldStart = (size_t)((ptrdiff_t)start - delta);
+
+			while (old < lines.size() && lines[old].start < OldStart) {
+				old++;
+			}
+
+			if (old < lines.size() && lines[old].start == OldStart) {
+				resume = old;
+				break;
+			}
+		}
+	}
+
+	layoutStats.linesLaidOut = newLines.size();
+	layoutStats.totalLinesLaidOut += newLines.size();
+
+	lines.erase(lines.begin() + first, lines.begin() + resume);
+	lines.insert(lines.begin() + first, std::make_move_iterator(newLines.begin()), std::make_move_iterator(newLines.end()));
+
+	for (size_t i = first + newLines.size(); i < lines.size(); i++) {
+		lines[i].start += delta;
+	}
+
+	maxWidth = 0;
+	for (const ParagraphLine& line : lines) {
+		maxWidth = std::max(maxWidth, line.width);
+	}
+}
+
+void Paragraph::LayoutLine(size_t start, ParagraphLine& line) {
+	const float WrapWidth = desc.wrapWidth;
+	uint32_t previous = 0;
+	float x = 0;
+	float width = 0; // Up to the last character that isn't a space
+	size_t breakAt = start; // Just past the last place the line may break
+	float breakWidth = 0;
+	size_t i = start;
+
+	line.start = start;
+	line.hardBreak = false;
+
+	for (; i < text.size(); i++) {
+		const uint32_t C = text[i];
+
+		if (C == '\n') {
+			line.hardBreak = true;
+			break;
+		}
+
+		float next;
+		if (C == '\t') {
+			next = NextTabStop(x);
+		}
+		else {
+			next = x + metrics.GetAdvance(C);
+
+			if (metrics.hasKerning) {
+				next += metrics.GetKerning(previous, C);
+			}
+		}
+
+		previous = C;
+
+		// Spaces hang past the wrap width, a line can break after them
+		if (IsSpace(C)) {
+			x = next;
+			breakAt = i + 1;
+			breakWidth = width;
+			continue;
+		}
+
+		// Back up to the last break, or cut the word when there's none
+		if (WrapWidth > 0 && next > WrapWidth && i > start) {
+			if (breakAt > start) {
+				line.length = breakAt - start;
+				line.width = breakWidth;
+			}
+			else {
+				line.length = i - start;
+				line.width = width;
+			}
+
+			ShapeLine(line);
+			return;
+		}
+
+		x = next;
+		width = x;
+
+		if (C == '-') {
+			breakAt = i + 1;
+			breakWidth = width;
+		}
+	}
+
+	line.length = i - start;
+	line.width = width;
+	ShapeLine(line);
+}
+
+void Paragraph::ShapeLine(ParagraphLine& line) {
+	const uint32_t* Text = text.data() + line.start;
+	size_t segmentStart = 0;
+	float x = 0;
+
+	line.run.glyphs.clear();
+
+	// Tabs aren't drawn, the text between them is shaped a piece at a
+	// time and moved to its tab stop
+	for (size_t i = 0; i <= line.length; i++) {
+		if (i < line.length && Text[i] != '\t') {
+			continue;
+		}
+
+		const size_t FirstGlyph = line.run.glyphs.size();
+		shaper.ShapeLine(Text + segmentStart, i - segmentStart, 0, line.run);
+
+		for (size_t g = FirstGlyph; g < line.run.glyphs.size(); g++) {
+			line.run.glyphs[g].x += x;
+		}
+
+		if (i < line.length) {
+			x = NextTabStop(x + Measure(Text + segmentStart, i - segmentStart));
+		}
+
+		segmentStart = i + 1;
+	}
+}
+
+float Paragraph::Measure(const uint32_t* text, size_t length) {
+	uint32_t previous = 0;
+	float x = 0;
+
+	for (size_t i = 0; i < length; i++) {
+		x += metrics.GetAdvance(text[i]);
+
+		if (metrics.hasKerning) {
+			x += metrics.GetKerning(previous, text[i]);
+		}
+
+		previous = text[i];
+	}
+
+	return x;
+}
+
+float Paragraph::NextTabStop(float x) const {
+	return (std::floor(x / tabWidth) + 1) * tabWidth;
+}
@@ -159,19 +159,45 @@ TextureHandle LoadTexture(const void* buffer, size_t size) {
 	return textureHandle;
 }
 
+// GLES2 has no sized internal formats, so internal format and format match
+static GLenum GetTextureFormatEnum(TextureFormat format) {
+	switch (format) {
+	case TextureFormat::Alpha8:
+		return GL_ALPHA;
+	case TextureFormat::RGBA8:
+	default:
+		return GL_RGBA;
+	}
+}
+
+size_t GetTextureFormatSize(TextureFormat format) {
+	switch (format) {
+	case TextureFormat::Alpha8:
+		return 1;
+	case TextureFormat::RGBA8:
+	default:
+		return 4;
+	}
+}
+
 TextureHandle CreateGraphicsTexture(TextureDesc& desc, const void* initial) {
 	TextureHandle textureHandle;
+	const GLenum Format = GetTextureFormatEnum(desc.format);
+
 	textureHandle.desc = desc;
 	glGenTextures(1, &textureHandle.textureHandle);
 	glBindTexture(GL_TEXTURE_2D, textureHandle.textureHandle);
+
+	// Rows of single channel textures aren't 4 byte aligned
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
 	glTexImage2D(
 		GL_TEXTURE_2D,
 		0,
-		GL_RGBA,
+		Format,
 		desc.width,
 		desc.height,
 		0,
-		GL_RGBA,
+		Format,
 		GL_UNSIGNED_BYTE,
 		initial
 	);
@@ -181,39 +207,112 @@ TextureHandle CreateGraphicsTexture(TextureDesc& desc, const void* initial) {
 	return textureHandle;
 }
 
+void UpdateGraphicsTexture(TextureHandle& texture, size_t x, size_t y, size_t width, size_t height, const void* data) {
+	const GLenum Format = GetTextureFormatEnum(texture.desc.format);
+
+	glBindTexture(GL_TEXTURE_2D, texture.textureHandle);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	glTexSubImage2D(
+		GL_TEXTURE_2D,
+		0,
+		(GLint)x,
+		(GLint)y,
+		(GLsizei)width,
+		(GLsizei)height,
+		Format,
+		GL_UNSIGNED_BYTE,
+		data
+	);
+	glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+
+static void ApplyBlendMode(BlendMode blend) {
+	if (blend == BlendMode::Alpha) {
+		glEnable(GL_BLEND);
+		glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+	}
+	else {
+		glDisable(GL_BLEND);
+	}
+}
 
 void SubmitRenderCalls(RenderContext& context, const RenderCall* renderCalls, size_t numRenderCalls) {
+	GLuint program = 0;
+	GLuint vertexBuffer = 0;
+	GLuint indexBuffer = 0;
+	GLuint texture = 0;
+	BlendMode blend = BlendMode::Alpha;
+
+	// Of the current program, looked up whenever it changes
+	GLuint attributes[4] = {};
+	GLint u_translation = -1;
+	GLint u_color = -1;
+
 	for (size_t i = 0; i < numRenderCalls; i++) {
 		auto& rc = renderCalls[i];
-
-		GLuint a_position = glGetAttribLocation(rc.program, "a_position");
-		GLuint a_normal = glGetAttribLocation(rc.program, "a_normal");
-		GLuint a_color0 = glGetAttribLocation(rc.program, "a_color0");
-		GLuint a_texcoord0 = glGetAttribLocation(rc.program, "a_texcoord0");
-
-		glEnableVertexAttribArray(a_position);
-		glEnableVertexAttribArray(a_normal);
-		glEnableVertexAttribArray(a_color0);
-		glEnableVertexAttribArray(a_texcoord0);
-
-		size_t offset = 0;
-		glVertexAttribPointer(a_position, 3, GL_FLOAT, GL_FALSE, sizeof(SpriteVertex), (void*)offset);
-		offset += sizeof(Math::Vector3f);
-		glVertexAttribPointer(a_normal, 3, GL_FLOAT, GL_TRUE, sizeof(SpriteVertex), (void*)offset);
-		offset += sizeof(Math::Vector3f);
-		glVertexAttribPointer(a_color0, 3, GL_FLOAT, GL_FALSE, sizeof(SpriteVertex), (void*)offset);
-		offset += sizeof(Math::Vector3f);
-		glVertexAttribPointer(a_texcoord0, 2, GL_FLOAT, GL_FALSE, sizeof(SpriteVertex), (void*)offset);
-		offset += sizeof(Math::Vector2f);
-
-		glBindBuffer(GL_ARRAY_BUFFER, rc.vertexBuffer);
-		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, rc.indexBuffer);
-		glBindTexture(GL_TEXTURE_2D, rc.texture);
-		glUseProgram(rc.program);
+		const bool ProgramChanged = (i == 0 || rc.program != program);
+
+		if (i == 0 || rc.blend != blend) {
+			ApplyBlendMode(rc.blend);
+			blend = rc.blend;
+		}
+
+		if (ProgramChanged) {
+			for (size_t a = 0; i > 0 && a < 4; a++) {
+				glDisableVertexAttribArray(attributes[a]);
+			}
+
+			glUseProgram(rc.program);
+			program = rc.program;
+
+			attributes[0] = glGetAttribLocation(program, "a_position");
+			attributes[1] = glGetAttribLocation(program, "a_normal");
+			attributes[2] = glGetAttribLocation(program, "a_color0");
+			attributes[3] = glGetAttribLocation(program, "a_texcoord0");
+			u_translation = glGetUniformLocation(program, "u_translation");
+			u_color = glGetUniformLocation(program, "u_color");
+
+			for (GLuint attribute : attributes) {
+				glEnableVertexAttribArray(attribute);
+			}
+		}
+
+		// The attribute pointers read from whatever buffer is bound, so
+		// they're set again along with it
+		if (ProgramChanged || rc.vertexBuffer != vertexBuffer) {
+			glBindBuffer(GL_ARRAY_BUFFER, rc.vertexBuffer);
+			vertexBuffer = rc.vertexBuffer;
+
+			size_t offset = 0;
+			glVertexAttribPointer(attributes[0], 3, GL_FLOAT, GL_FALSE, sizeof(SpriteVertex), (void*)offset);
+			offset += sizeof(Math::Vector3f);
+			glVertexAttribPointer(attributes[1], 3, GL_FLOAT, GL_TRUE, sizeof(SpriteVertex), (void*)offset);
+			offset += sizeof(Math::Vector3f);
+			glVertexAttribPointer(attributes[2], 3, GL_FLOAT, GL_FALSE, sizeof(SpriteVertex), (void*)offset);
+			offset += sizeof(Math::Vector3f);
+			glVertexAttribPointer(attributes[3], 2, GL_FLOAT, GL_FALSE, sizeof(SpriteVertex), (void*)offset);
+			offset += sizeof(Math::Vector2f);
+		}
+
+		if (i == 0 || rc.indexBuffer != indexBuffer) {
+			glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, rc.indexBuffer);
+			indexBuffer = rc.indexBuffer;
+		}
+
+		if (i == 0 || rc.texture != texture) {
+			glBindTexture(GL_TEXTURE_2D, rc.texture);
+			texture = rc.texture;
+		}
+
+		glUniform2f(u_translation, rc.translation.x, rc.translation.y);
+		glUniform3f(u_color, rc.color.x, rc.color.y, rc.color.z);
 		glDrawElements(GL_TRIANGLES, rc.numVertices, GL_UNSIGNED_SHORT, (const void*)(size_t)rc.indexBase);
-		glDisableVertexAttribArray(a_texcoord0);
-		glDisableVertexAttribArray(a_color0);
-		glDisableVertexAttribArray(a_normal);
-		glDisableVertexAttribArray(a_position);
+	}
+
+	if (numRenderCalls > 0) {
+		for (GLuint attribute : attributes) {
+			glDisableVertexAttribArray(attribute);
+		}
 	}
 }
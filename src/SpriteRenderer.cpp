@@ -1,21 +1,57 @@
 #include "SpriteRenderer.hpp"
 #include "Utility.hpp"
 
-SpriteRenderer::SpriteRenderer(RenderContext& context, const uint16_t MaxSprites) :
-	context(context),
-	vbCapacity(MaxSprites * 4),
-	ibCapacity(MaxSprites * 6),
+static GLuint LoadProgram(RenderContext& context, const char* vsPath, const char* fsPath) {
+	std::vector<uint8_t> vs, fs;
+
+	Utility::LoadFile(vsPath, vs);
+	Utility::LoadFile(fsPath, fs);
+
+	GLuint vsh, fsh;
+	vsh = CompileShader(context, GL_VERTEX_SHADER, vs.data(), vs.size());
+	fsh = CompileShader(context, GL_FRAGMENT_SHADER, fs.data(), fs.size());
+
+	GLuint program = CreateGraphicsProgram(context, vsh, fsh);
+
+	glDeleteShader(vsh);
+	glDeleteShader(fsh);
+
+	return program;
+}
+
+void BuildQuadVertices(const Math::Vector4f& src, const Math::Vector4f& dst, const Math::Vector3f& color, const Math::Vector3f& normal, SpriteVertex out[4]) {
+	out[0] = { Math::Vector3f(dst.x,         dst.y,         0), normal, color, Math::Vector2f(src.x, src.y) };
+	out[1] = { Math::Vector3f(dst.x,         dst.y + dst.w, 0), normal, color, Math::Vector2f(src.x, src.w) };
+	out[2] = { Math::Vector3f(dst.x + dst.z, dst.y + dst.w, 0), normal, color, Math::Vector2f(src.z, src.w) };
+	out[3] = { Math::Vector3f(dst.x + dst.z, dst.y,         0), normal, color, Math::Vector2f(src.z, src.y) };
+}
+
+SpriteRenderer::SpriteRenderer(RenderContext& context, size_t maxSprites) :
 	vertices(nullptr),
 	indices(nullptr),
+	context(context),
+	renderCalls(nullptr),
+	numRenderCalls(0),
+	batch(nullptr),
+	overflowCall(),
+	vertexBuffer(0),
+	indexBuffer(0),
+	programs(),
 	vbCursor(0),
 	ibCursor(0),
 	rcCursor(0),
-	vertexBuffer(0),
-	indexBuffer(0),
-	program(0),
-	numRenderCalls(0),
-	renderCalls(nullptr)
+	vbCapacity(0),
+	ibCapacity(0),
+	frameIndex(0),
+	blendMode(BlendMode::Alpha)
 {
+	if (maxSprites > MaxSpritesLimit) {
+		maxSprites = MaxSpritesLimit;
+	}
+
+	vbCapacity = (uint32_t)maxSprites * 4;
+	ibCapacity = (uint32_t)maxSprites * 6;
+
 	vertices = new SpriteVertex[vbCapacity];
 	indices = new uint16_t[ibCapacity];
 
@@ -33,66 +69,193 @@ SpriteRenderer::SpriteRenderer(RenderContext& context, const uint16_t MaxSprites
 		nullptr
 	);
 
-	numRenderCalls = MaxSprites;
+	numRenderCalls = (uint32_t)maxSprites;
 	renderCalls = new RenderCall[numRenderCalls];
 
-	std::vector<uint8_t> vs, fs;
-
-	Utility::LoadFile("assets/shaders/sprite/sprite-v.glsl", vs);
-	Utility::LoadFile("assets/shaders/sprite/sprite-f.glsl", fs);
-
-	GLuint vsh, fsh;
-	vsh = CompileShader(context, GL_VERTEX_SHADER, vs.data(), vs.size());
-	fsh = CompileShader(context, GL_FRAGMENT_SHADER, fs.data(), fs.size());
-
-	program = CreateGraphicsProgram(context, vsh, fsh);
-
-	glDeleteShader(vsh);
-	glDeleteShader(fsh);
+	// Single channel textures keep their coverage in alpha, so they get
+	// their own fragment shader
+	programs[(size_t)SpriteShader::Rgba] = LoadProgram(
+		context,
+		"assets/shaders/sprite/sprite-v.glsl",
+		"assets/shaders/sprite/sprite-f.glsl"
+	);
+	programs[(size_t)SpriteShader::Alpha] = LoadProgram(
+		context,
+		"assets/shaders/sprite/sprite-v.glsl",
+		"assets/shaders/sprite/sprite-alpha-f.glsl"
+	);
+	programs[(size_t)SpriteShader::DistanceField] = LoadProgram(
+		context,
+		"assets/shaders/sprite/sprite-v.glsl",
+		"assets/shaders/sprite/sprite-sdf-f.glsl"
+	);
 }
 
 SpriteRenderer::~SpriteRenderer() {
 	delete[] vertices;
 	delete[] indices;
 	delete[] renderCalls;
+
+	for (GLuint program : programs) {
+		glDeleteProgram(program);
+	}
 }
 
 void SpriteRenderer::PushSprite(TextureHandle textureHandle, const Math::Vector4f& src, const Math::Vector4f& dst, const Math::Vector3f& color) {
-	auto& rc = renderCalls[rcCursor++];
+	BeginBatch(textureHandle);
+	PushQuad(src, dst, color);
+	EndBatch();
+}
 
-	const uint16_t NumVertices = 4;
-	const uint16_t NumIndices = 6;
+void SpriteRenderer::BeginBatch(TextureHandle textureHandle) {
+	const SpriteShader Shader = (textureHandle.desc.format == TextureFormat::Alpha8) ?
+		SpriteShader::Alpha :
+		SpriteShader::Rgba;
 
-	SpriteVertex nv[NumVertices] = {
-		{ Math::Vector3f(0,     0,     0), Math::Vector3f(0, 0, 0), color, Math::Vector2f(src.x, src.y) },
-		{ Math::Vector3f(0,     dst.w, 0), Math::Vector3f(0, 0, 0), color, Math::Vector2f(src.x, src.w) },
-		{ Math::Vector3f(dst.z, dst.w, 0), Math::Vector3f(0, 0, 0), color, Math::Vector2f(src.z, src.w) },
-		{ Math::Vector3f(dst.z, 0,     0), Math::Vector3f(0, 0, 0), color, Math::Vector2f(src.z, src.y) }
-	};
-	uint16_t ni[NumIndices] = { 0, 1, 2, 2, 0, 3 };
+	BeginBatch(textureHandle, Shader);
+}
+
+void SpriteRenderer::BeginBatch(TextureHandle textureHandle, SpriteShader shader) {
+	const GLuint Program = programs[(size_t)shader];
+
+	batchStats.batches++;
 
-	for (size_t i = 0; i < NumVertices; i++) {
-		nv[i].a_position = nv[i].a_position + Math::Vector3f(dst.x, dst.y, 0);
+	// Keep adding to the last call when nothing but the index range would
+	// change. Its indices have to end where this batch's start, retained
+	// geometry from PushRenderCall never matches since it has other buffers.
+	if (rcCursor > 0) {
+		RenderCall& last = renderCalls[rcCursor - 1];
+
+		if (last.texture == textureHandle.textureHandle &&
+			last.program == Program &&
+			last.blend == blendMode &&
+			last.vertexBuffer == vertexBuffer &&
+			last.indexBuffer == indexBuffer &&
+			last.indexBase + last.numVertices * sizeof(uint16_t) == ibCursor * sizeof(uint16_t)) {
+			batchStats.merged++;
+			batch = &last;
+			return;
+		}
 	}
 
-	for (size_t i = 0; i < NumIndices; i++) {
-		ni[i] += vbCursor;
+	// Out of calls, the quads of this batch go nowhere
+	if (rcCursor == numRenderCalls) {
+		overflowStats.droppedCalls++;
+		overflowCall.numVertices = 0;
+		batch = &overflowCall;
+		return;
 	}
 
-	memcpy(&vertices[vbCursor], nv, sizeof(nv));
-	memcpy(&indices[ibCursor], ni, sizeof(ni));
+	auto& rc = renderCalls[rcCursor++];
 
 	rc.texture = textureHandle.textureHandle;
 	rc.vertexBuffer = vertexBuffer;
 	rc.indexBuffer = indexBuffer;
-	rc.program = program;
+	rc.program = Program;
 	rc.indexBase = ibCursor * sizeof(uint16_t);
-	rc.numVertices = NumIndices;
+	rc.numVertices = 0;
+	rc.translation = Math::Vector2f(0, 0);
+	rc.color = Math::Vector3f(1, 1, 1);
+	rc.blend = blendMode;
+
+	batch = &rc;
+}
+
+void SpriteRenderer::PushQuad(const Math::Vector4f& src, const Math::Vector4f& dst, const Math::Vector3f& color, const Math::Vector3f& normal) {
+	const uint16_t NumVertices = 4;
+	const uint16_t NumIndices = 6;
+
+	if (batch == &overflowCall || !HasRoom(1)) {
+		overflowStats.droppedQuads++;
+		return;
+	}
+
+	uint16_t ni[NumIndices] = { 0, 1, 2, 2, 0, 3 };
+
+	for (size_t i = 0; i < NumIndices; i++) {
+		ni[i] += (uint16_t)vbCursor;
+	}
+
+	BuildQuadVertices(src, dst, color, normal, &vertices[vbCursor]);
+	memcpy(&indices[ibCursor], ni, sizeof(ni));
+
+	batch->numVertices += NumIndices;
 
 	vbCursor += NumVertices;
 	ibCursor += NumIndices;
 }
 
+void SpriteRenderer::PushQuads(const SpriteVertex* quadVertices, size_t numQuads) {
+	SpriteVertex* out = ReserveQuads(numQuads);
+
+	if (numQuads > 0) {
+		memcpy(out, quadVertices, numQuads * 4 * sizeof(SpriteVertex));
+	}
+}
+
+SpriteVertex* SpriteRenderer::ReserveQuads(size_t& numQuads) {
+	if (batch == &overflowCall) {
+		overflowStats.droppedQuads += numQuads;
+		numQuads = 0;
+		return nullptr;
+	}
+
+	// Keep whatever fits
+	const size_t Room = (vbCapacity - vbCursor) / 4;
+	if (numQuads > Room) {
+		overflowStats.droppedQuads += numQuads - Room;
+		numQuads = Room;
+	}
+
+	SpriteVertex* out = &vertices[vbCursor];
+
+	for (size_t i = 0; i < numQuads; i++) {
+		const uint16_t Base = (uint16_t)(vbCursor + i * 4);
+		uint16_t* ni = &indices[ibCursor + i * 6];
+
+		ni[0] = Base;
+		ni[1] = Base + 1;
+		ni[2] = Base + 2;
+		ni[3] = Base + 2;
+		ni[4] = Base;
+		ni[5] = Base + 3;
+	}
+
+	batch->numVertices += (uint32_t)(numQuads * 6);
+
+	vbCursor += (uint32_t)(numQuads * 4);
+	ibCursor += (uint32_t)(numQuads * 6);
+
+	return out;
+}
+
+void SpriteRenderer::EndBatch() {
+	// Nothing was pushed, don't leave an empty draw behind. A merged batch
+	// always has the quads of the one before.
+	if (batch != &overflowCall && batch->numVertices == 0) {
+		rcCursor--;
+	}
+
+	batch = nullptr;
+}
+
+bool SpriteRenderer::HasRoom(size_t numQuads) const {
+	return vbCursor + numQuads * 4 <= vbCapacity && ibCursor + numQuads * 6 <= ibCapacity;
+}
+
+void SpriteRenderer::PushRenderCall(const RenderCall& call) {
+	if (rcCursor == numRenderCalls) {
+		overflowStats.droppedCalls++;
+		return;
+	}
+
+	renderCalls[rcCursor++] = call;
+}
+
+void SpriteRenderer::SetBlendMode(BlendMode blend) {
+	blendMode = blend;
+}
+
 void SpriteRenderer::BuildCommandList(RenderCall* out, size_t& outCount) {
 	glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
 	glBufferSubData(GL_ARRAY_BUFFER, 0, vbCursor * sizeof(SpriteVertex), vertices);
@@ -104,4 +267,18 @@ void SpriteRenderer::BuildCommandList(RenderCall* out, size_t& outCount) {
 	rcCursor = 0;
 	vbCursor = 0;
 	ibCursor = 0;
+	frameIndex++;
+}
+
+void SpriteRenderer::Discard() {
+	rcCursor = 0;
+	vbCursor = 0;
+	ibCursor = 0;
 }
+
+void SpriteRenderer::SetTransform(const Math::Matrix4x4f& mvp) {
+	for (GLuint program : programs) {
+		glUseProgram(program);
+		glUniformMatrix4fv(glGetUniformLocation(program, "u_mvp"), 1, GL_FALSE, (const float*)& mvp);
+	}
+}
\ No newline at end of file
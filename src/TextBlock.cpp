@@ -0,0 +1,76 @@
+#include "TextBlock.hpp"
+#include <utility>
+
+TextBlock::TextBlock() :
+	size(0),
+	face(0),
+	complete(false),
+	dirty(true),
+	retryFrame(0),
+	retryDelay(0),
+	vertexBuffer(0),
+	indexBuffer(0)
+{
+}
+
+TextBlock::~TextBlock() {
+	if (vertexBuffer) {
+		glDeleteBuffers(1, &vertexBuffer);
+	}
+
+	if (indexBuffer) {
+		glDeleteBuffers(1, &indexBuffer);
+	}
+}
+
+TextBlock::TextBlock(TextBlock&& other) noexcept :
+	text(std::move(other.text)),
+	size(other.size),
+	face(other.face),
+	complete(other.complete),
+	dirty(other.dirty),
+	retryFrame(other.retryFrame),
+	retryDelay(other.retryDelay),
+	keys(std::move(other.keys)),
+	placements(std::move(other.placements)),
+	batches(std::move(other.batches)),
+	vertexBuffer(other.vertexBuffer),
+	indexBuffer(other.indexBuffer)
+{
+	other.vertexBuffer = 0;
+	other.indexBuffer = 0;
+	other.dirty = true;
+}
+
+TextBlock& TextBlock::operator=(TextBlock&& other) noexcept {
+	if (this == &other) {
+		return *this;
+	}
+
+	if (vertexBuffer) {
+		glDeleteBuffers(1, &vertexBuffer);
+	}
+
+	if (indexBuffer) {
+		glDeleteBuffers(1, &indexBuffer);
+	}
+
+	text = std::move(other.text);
+	size = other.size;
+	face = other.face;
+	complete = other.complete;
+	dirty = other.dirty;
+	retryFrame = other.retryFrame;
+	retryDelay = other.retryDelay;
+	keys = std::move(other.keys);
+	placements = std::move(other.placements);
+	batches = std::move(other.batches);
+	vertexBuffer = other.vertexBuffer;
+	indexBuffer = other.indexBuffer;
+
+	other.vertexBuffer = 0;
+	other.indexBuffer = 0;
+	other.dirty = true;
+
+	return *this;
+}
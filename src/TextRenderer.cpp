@@ -1,133 +1,1475 @@
 #include "TextRenderer.hpp"
+#include "Utility.hpp"
+#include "Unicode.hpp"
 #include <iostream>
+#include <fstream>
+#include <cstdio>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+
+// Layout of the files written by SaveCache, in native byte order. Bump
+// GlyphCacheVersion whenever it or the meaning of a field changes.
+static const uint32_t GlyphCacheMagic = 0x43594C47; // "GLYC"
+static const uint32_t GlyphCacheVersion = 7;
+
+struct GlyphCacheHeader {
+	uint32_t magic;
+	uint32_t version;
+	uint64_t fontHash; // Over every face's fonts, size, style and subpixel positions, in order
+	uint32_t fontSize;
+	uint32_t spread;
+	uint32_t format;
+	uint32_t padding;
+	uint32_t pageWidth;
+	uint32_t pageHeight;
+	uint32_t numPages;
+	uint32_t numGlyphs;
+};
+
+// Followed by numGlyphs records, then the pixels of every page
+struct GlyphCacheRecord {
+	uint32_t codepoint;
+	uint16_t x, y, w, h;
+	uint16_t slotW, slotH;
+	uint16_t page;
+	int16_t bearingX, bearingY;
+	uint16_t advance;
+};
+
+// True when two records have the same key, or their slots overlap on the
+// same page. Sorts its own copy of the records.
+static bool HasConflictingRecords(std::vector<GlyphCacheRecord> records) {
+	std::sort(records.begin(), records.end(), [](const GlyphCacheRecord& a, const GlyphCacheRecord& b) {
+		return a.codepoint < b.codepoint;
+	});
+
+	for (size_t i = 1; i < records.size(); i++) {
+		if (records[i].codepoint == records[i - 1].codepoint) {
+			return true;
+		}
+	}
+
+	// By page and top, a slot can only overlap the ones after it that
+	// start above its bottom
+	std::sort(records.begin(), records.end(), [](const GlyphCacheRecord& a, const GlyphCacheRecord& b) {
+		return a.page != b.page ? a.page < b.page : a.y < b.y;
+	});
+
+	for (size_t i = 0; i < records.size(); i++) {
+		const GlyphCacheRecord& A = records[i];
+
+		for (size_t j = i + 1; j < records.size() && records[j].page == A.page && records[j].y < A.y + A.slotH; j++) {
+			const GlyphCacheRecord& B = records[j];
+
+			if (A.slotW > 0 && B.slotW > 0 && B.slotH > 0 &&
+				B.x < A.x + A.slotW && A.x < B.x + B.slotW) {
+				return true;
+			}
+		}
+	}
+
+	return false;
+}
+
+// FNV-1a, only has to tell fonts and strings apart. Pass the previous
+// hash to continue it over another buffer.
+static uint64_t HashBuffer(const void* buffer, size_t size, uint64_t hash = 0xCBF29CE484222325ull) {
+	const uint8_t* bytes = (const uint8_t*)buffer;
+
+	for (size_t i = 0; i < size; i++) {
+		hash ^= bytes[i];
+		hash *= 0x100000001B3ull;
+	}
+
+	return hash;
+}
+
+// Codepoints MeasureString decodes on the stack at a time
+static const size_t MeasureChunkSize = 256;
+
+// Where measuring a string has got to, carried from one decoded chunk to
+// the next. In pixels at the face's size.
+struct MeasurePen {
+	float x = 0;
+	float width = 0; // Widest line before the current one
+	uint32_t previous = 0;
+	size_t line = 0;
+	size_t index = 0; // Codepoints measured so far
+};
+
+// Advances and kerning the way TextShaper lays out unshaped text
+static void MeasureChunk(FontMetrics& metrics, const uint32_t* text, size_t length, float scale, MeasurePen& pen, Math::Vector2f* carets, size_t maxCarets) {
+	const float LineHeight = metrics.lineHeight * scale;
+
+	for (size_t i = 0; i < length; i++, pen.index++) {
+		const uint32_t C = text[i];
+
+		if (C == '\n') {
+			if (pen.index < maxCarets) {
+				carets[pen.index] = Math::Vector2f(pen.x * scale, -(float)pen.line * LineHeight);
+			}
+
+			pen.width = std::max(pen.width, pen.x);
+			pen.x = 0;
+			pen.previous = 0;
+			pen.line++;
+			continue;
+		}
+
+		if (metrics.hasKerning) {
+			pen.x += metrics.GetKerning(pen.previous, C);
+		}
+
+		if (pen.index < maxCarets) {
+			carets[pen.index] = Math::Vector2f(pen.x * scale, -(float)pen.line * LineHeight);
+		}
+
+		pen.x += metrics.GetAdvance(C);
+		pen.previous = C;
+	}
+}
+
+static void FinishMeasure(const FontMetrics& metrics, float scale, const MeasurePen& pen, TextExtents& out, Math::Vector2f* carets, size_t maxCarets) {
+	const float LineHeight = metrics.lineHeight * scale;
+
+	if (pen.index < maxCarets) {
+		carets[pen.index] = Math::Vector2f(pen.x * scale, -(float)pen.line * LineHeight);
+	}
+
+	out.width = std::max(pen.width, pen.x) * scale;
+	out.numLines = pen.line + 1;
+	out.height = out.numLines * LineHeight;
+	out.numCodepoints = pen.index;
+}
+
+static TextRendererDesc MakeDesc(size_t fontSize, const void* fontBuffer, size_t size) {
+	TextRendererDesc desc;
+	desc.fontSize = fontSize;
+	desc.fontBuffer = fontBuffer;
+	desc.fontBufferSize = size;
+	return desc;
+}
+
+// Distance fields need the full 8 bits per texel and nothing more
+static GlyphAtlasDesc MakeAtlasDesc(const TextRendererDesc& desc) {
+	GlyphAtlasDesc atlasDesc = desc.atlas;
+
+	if (desc.distanceField) {
+		atlasDesc.format = TextureFormat::Alpha8;
+	}
+
+	return atlasDesc;
+}
 
 TextRenderer::TextRenderer(SpriteRenderer& spriteRenderer, size_t fontSize, const void* fontBuffer, size_t size) :
+	TextRenderer(spriteRenderer, MakeDesc(fontSize, fontBuffer, size))
+{
+}
+
+TextRenderer::TextRenderer(SpriteRenderer& spriteRenderer, const TextRendererDesc& desc) :
 	spriteRenderer(spriteRenderer),
-	cacheSurface(nullptr),
-	cacheTexture({}),
-	fontSize(fontSize),
-	xOffset(0),
-	yOffset(0),
-	yMax(0)
+	atlas(MakeAtlasDesc(desc)),
+	layoutCapacity(desc.layoutCacheSize),
+	atlasGeneration(0),
+	numPlacements(0),
+	currentFace(0),
+	asyncRasterization(desc.asyncRasterization),
+	distanceField(desc.distanceField),
+	spread(desc.distanceField ? desc.distanceFieldSpread : 0),
+	evictionCursor(0),
+	evictionFrame(0xFFFFFFFF)
 {
-	cacheSurface = SDL_CreateRGBSurfaceWithFormat(0, 1024, 1024, 32, SDL_PIXELFORMAT_RGBA8888);
+	FontFaceDesc faceDesc;
+	faceDesc.fontBuffer = desc.fontBuffer;
+	faceDesc.fontBufferSize = desc.fontBufferSize;
+	faceDesc.fallbackFonts = desc.fallbackFonts;
+	faceDesc.numFallbackFonts = desc.numFallbackFonts;
+	faceDesc.fontSize = desc.fontSize;
+	faceDesc.style = desc.style;
+	faceDesc.subpixelPositions = desc.subpixelPositions;
 
-	TextureDesc td = {};
-	td.width = cacheSurface->w;
-	td.height = cacheSurface->h;
-	cacheTexture = CreateGraphicsTexture(td, nullptr);
-	SDL_RWops* ops = SDL_RWFromConstMem(fontBuffer, size);
-	font = TTF_OpenFontRW(ops, SDL_TRUE, fontSize);
-	charScratch = new uint8_t[(size_t)cacheSurface->pitch * cacheSurface->h];
+	uint8_t id;
+	AddFace(faceDesc, id);
 }
 
 TextRenderer::~TextRenderer() {
-	TTF_CloseFont(font);
-	SDL_FreeSurface(cacheSurface);
-	delete[] charScratch;
+	for (FontFace* face : faces) {
+		delete face;
+	}
+}
+
+bool TextRenderer::AddFace(const FontFaceDesc& desc, uint8_t& id) {
+	if (faces.size() >= MaxFaces) {
+		return false;
+	}
+
+	id = (uint8_t)faces.size();
+	FontFace* face = new FontFace(desc, id, spread);
+
+#ifndef __EMSCRIPTEN__
+	if (asyncRasterization) {
+		face->asyncRasterizer = new AsyncGlyphRasterizer(face->fonts, face->fontSize, spread, face->style, face->subpixelPositions);
+	}
+#endif
+
+	faces.push_back(face);
+	return true;
 }
 
-void TextRenderer::AddCharacter(uint32_t c) {
-	Clip clip;
+void TextRenderer::SetFace(uint8_t id) {
+	if (id < faces.size()) {
+		currentFace = id;
+	}
+}
+
+FontFace& TextRenderer::GetFace() {
+	return *faces[currentFace];
+}
+
+FontFace& TextRenderer::GetFace(uint8_t id) {
+	return *faces[id];
+}
+
+bool TextRenderer::AddCharacter(uint32_t c) {
+	GlyphRasterizer& rasterizer = faces[GetGlyphFace(c)]->rasterizer;
+
+	// Distance fields and RGBA pages need the coverage in a bitmap first.
+	// Plain coverage is rendered straight into its slot in the atlas.
+	if (spread > 0 || atlas.desc.format != TextureFormat::Alpha8) {
+		return rasterizer.Rasterize(c, glyphScratch) && CommitGlyph(glyphScratch);
+	}
+
+	if (!rasterizer.Load(c, glyphScratch)) {
+		return false;
+	}
+
+	Glyph* glyph = PlaceGlyph(glyphScratch);
+
+	if (!glyph) {
+		return false;
+	}
+
+	// Rendering in place writes unclipped, so a slot that isn't wholly on
+	// the page takes the bitmap and the clipped copy CommitGlyph uses
+	if (glyph->x + glyph->w > atlas.desc.width || glyph->y + glyph->h > atlas.desc.height) {
+		if (rasterizer.Rasterize(c, glyphScratch)) {
+			atlas.WriteCoverage(glyph->page, glyph->x, glyph->y, glyph->w, glyph->h, glyphScratch.pixels.data(), glyphScratch.w, 1);
+		}
+
+		return true;
+	}
+
+	AtlasRect rect;
+	rect.x = glyph->x;
+	rect.y = glyph->y;
+	rect.w = glyph->w;
+	rect.h = glyph->h;
+
+	rasterizer.Render(atlas.GetTexel(glyph->page, glyph->x, glyph->y), -(ptrdiff_t)atlas.pitch);
+	atlas.MarkDirty(glyph->page, rect);
+
+	return true;
+}
+
+bool TextRenderer::CommitGlyph(const GlyphBitmap& bitmap) {
+	Glyph* glyph = PlaceGlyph(bitmap);
+
+	if (!glyph) {
+		return false;
+	}
+
+	atlas.WriteCoverage(glyph->page, glyph->x, glyph->y, glyph->w, glyph->h, bitmap.pixels.data(), bitmap.w, 1);
+	return true;
+}
+
+Glyph* TextRenderer::PlaceGlyph(const GlyphBitmap& bitmap) {
+	AtlasRect slot;
+	uint16_t page = 0;
+	const uint16_t SlotW = bitmap.w + PaddingX;
+	const uint16_t SlotH = bitmap.h + PaddingY;
+
+	// Never fits, however much is evicted
+	if (SlotW > atlas.desc.width || SlotH > atlas.desc.height) {
+		return nullptr;
+	}
+
+	// Once the atlas is full, take over the slot of a glyph that hasn't
+	// been drawn in a while
+	if (!atlas.Allocate(SlotW, SlotH, slot, page) && !EvictFor(SlotW, SlotH, slot, page)) {
+		return nullptr;
+	}
+
+	Glyph& glyph = glyphs.Insert(bitmap.codepoint);
+	glyph.x = slot.x;
+	glyph.y = slot.y;
+	glyph.w = bitmap.w;
+	glyph.h = bitmap.h;
+	glyph.slotW = slot.w;
+	glyph.slotH = slot.h;
+	glyph.page = page;
+	glyph.lastUsedFrame = spriteRenderer.frameIndex;
+	glyph.placement = ++numPlacements;
+	SetGlyphMetrics(glyph, bitmap.bearingX, bitmap.bearingY, bitmap.advance);
+	subpixelStats.added[GetGlyphPhase(bitmap.codepoint)]++;
 
-	SDL_Surface* s = TTF_RenderGlyph_Blended(font, c, SDL_Color{ 0xFF, 0, 0, 0xFF });
+	return &glyph;
+}
+
+void TextRenderer::Prewarm(const CodepointRange* ranges, size_t numRanges, size_t numThreads) {
+	const FontFace& Face = GetFace();
+	std::vector<uint32_t> missing;
 
-	const size_t Pitch = s->pitch;
-	const uint8_t* Src = (uint8_t*)s->pixels;
+	// Every phase, any of them can come up while drawing
+	for (size_t i = 0; i < numRanges; i++) {
+		// Nothing past U+10FFFF is a codepoint, and stopping there keeps c from wrapping
+		const uint32_t Last = std::min(ranges[i].last, (uint32_t)0x10FFFF);
 
-	// Use our pre-allocated buffer as our scratchpad,
-	// SDL TTF already does an allocation every time we
-	// want to render a Glyph (I think) >.>
-	uint8_t* dst = charScratch;
+		for (uint32_t c = ranges[i].first; c <= Last; c++) {
+			for (uint8_t phase = 0; phase < Face.subpixelPositions; phase++) {
+				const uint32_t Key = SetGlyphPhase(SetGlyphFace(c, Face.id), phase);
 
-	// Flip the image
-	for (size_t i = 0; i < s->h; i++) {
-		const uint8_t* SrcLine = Src + (Pitch * (s->h - i - 1));
-		memcpy(dst + (Pitch * i), SrcLine, Pitch);
+				if (!glyphs.Find(Key)) {
+					missing.push_back(Key);
+				}
+			}
+		}
 	}
 
-	// Copy over our results 7
-	memcpy(s->pixels, dst, Pitch * s->h);
+	if (missing.empty()) {
+		return;
+	}
 
-	clip.x = xOffset;
-	clip.y = yOffset;
-	clip.w = s->w;
-	clip.h = s->h;
+#ifdef __EMSCRIPTEN__
+	// No threads without -s USE_PTHREADS, the pool degrades to this thread
+	numThreads = 1;
+#else
+	if (numThreads == 0) {
+		numThreads = std::max(1u, std::thread::hardware_concurrency());
+	}
+#endif
+	numThreads = std::min(numThreads, missing.size());
 
-	xOffset += (s->w + PaddingX);
+	std::vector<GlyphBitmap> bitmaps(missing.size());
+	std::vector<uint8_t> rasterized(missing.size()); // Not vector<bool>, workers write it concurrently
+	std::vector<GlyphRasterizer*> workers;
+	std::vector<std::thread> threads;
+	std::atomic<size_t> next(0);
 
-	// Determine the baseline to move down
-	if (s->h > yMax) {
-		yMax = s->h;
+	// One per worker, they share no FreeType state
+	for (size_t i = 0; i < numThreads; i++) {
+		workers.push_back(new GlyphRasterizer(Face.fonts, Face.fontSize, spread, Face.style, Face.subpixelPositions));
 	}
 
-	// Move right on the texture until we reach the end,
-	// then move down
-	if (xOffset >= cacheSurface->w) {
-		xOffset = 0;
-		yOffset += (yMax + PaddingY);
+	auto work = [&](GlyphRasterizer* worker) {
+		for (size_t i = next++; i < missing.size(); i = next++) {
+			rasterized[i] = worker->Rasterize(missing[i], bitmaps[i]);
+		}
+	};
+
+	for (size_t i = 1; i < numThreads; i++) {
+		threads.push_back(std::thread(work, workers[i]));
 	}
 
-	SDL_Rect dstRect = { clip.x, clip.y, clip.w, clip.h };
-	SDL_BlitSurface(s, nullptr, cacheSurface, &dstRect);
+	work(workers[0]);
+
+	for (std::thread& thread : threads) {
+		thread.join();
+	}
+
+	for (GlyphRasterizer* worker : workers) {
+		delete worker;
+	}
 
-	clips[c] = clip;
-	SDL_FreeSurface(s);
+	// Tallest first packs tighter
+	std::vector<size_t> order;
+	for (size_t i = 0; i < bitmaps.size(); i++) {
+		if (rasterized[i]) {
+			order.push_back(i);
+		}
+	}
+
+	std::sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+		return bitmaps[a].h > bitmaps[b].h;
+	});
+
+	for (size_t i : order) {
+		if (!CommitGlyph(bitmaps[i])) {
+			break;
+		}
+	}
+
+	UpdateTexture();
 }
 
 void TextRenderer::WriteString(Math::Vector2f position, Math::Vector3f color, const char* message, size_t length) {
-	int x = 0;
-	int y = 0;
-	for (size_t i = 0; i < length; i++) {
-		uint32_t c = (uint32_t)message[i];
-		const auto& it = clips.find(c);
-
-		if (c == '\n') {
-			y -= yMax;
-			x = 0;
+	WriteString(position, color, message, length, (float)GetFace().fontSize);
+}
+
+void TextRenderer::WriteString(Math::Vector2f position, Math::Vector3f color, const char* message, size_t length, float size) {
+	// Never shrunk, so decoding only allocates for the longest string yet
+	if (codepoints.size() < length) {
+		codepoints.resize(length);
+	}
+
+	const size_t Count = Unicode::DecodeUtf8(message, length, codepoints.data());
+	WriteCodepoints(position, color, codepoints.data(), Count, size);
+}
+
+void TextRenderer::WriteString(Math::Vector2f position, Math::Vector3f color, const char16_t* message, size_t length) {
+	WriteString(position, color, message, length, (float)GetFace().fontSize);
+}
+
+void TextRenderer::WriteString(Math::Vector2f position, Math::Vector3f color, const char16_t* message, size_t length, float size) {
+	if (codepoints.size() < length) {
+		codepoints.resize(length);
+	}
+
+	const size_t Count = Unicode::DecodeUtf16(message, length, codepoints.data());
+	WriteCodepoints(position, color, codepoints.data(), Count, size);
+}
+
+void TextRenderer::WriteString(Math::Vector2f position, Math::Vector3f color, const char32_t* message, size_t length) {
+	WriteString(position, color, message, length, (float)GetFace().fontSize);
+}
+
+void TextRenderer::WriteString(Math::Vector2f position, Math::Vector3f color, const char32_t* message, size_t length, float size) {
+	if (codepoints.size() < length) {
+		codepoints.resize(length);
+	}
+
+	// Anything past U+10FFFF would run into the face and phase bits of the glyph keys
+	const size_t Count = Unicode::DecodeUtf32(message, length, codepoints.data());
+	WriteCodepoints(position, color, codepoints.data(), Count, size);
+}
+
+void TextRenderer::WriteCodepoints(Math::Vector2f position, Math::Vector3f color, const uint32_t* text, size_t length, float size) {
+	FontFace& face = GetFace();
+	CachedLayout* layout = nullptr;
+
+	// Strings drawn the same way as before skip layout entirely
+	if (layoutCapacity > 0) {
+		uint64_t hash = HashBuffer(text, length * sizeof(uint32_t));
+		hash = HashBuffer(&position, sizeof(position), hash);
+		hash = HashBuffer(&color, sizeof(color), hash);
+		hash = HashBuffer(&size, sizeof(size), hash);
+		hash = HashBuffer(&face.id, sizeof(face.id), hash);
+
+		layout = FindLayout(hash, position, color, text, length, size, face.id);
+
+		if (layout && layout->complete && layout->generation == atlasGeneration) {
+			layoutStats.hits++;
+			ReplayLayout(*layout);
+			return;
+		}
+
+		layoutStats.misses++;
+
+		if (!layout) {
+			layout = &RecycleLayout(hash);
+			layout->text.assign(text, text + length);
+			layout->position = position;
+			layout->color = color;
+			layout->size = size;
+			layout->face = face.id;
+		}
+
+		layout->complete = true;
+		layout->keys.clear();
+		layout->batches.clear();
+		layout->vertices.clear();
+	}
+
+	uint32_t pagesUsed = 0;
+	const float Scale = size / face.fontSize;
+	const SpriteShader Shader = GetShader();
+
+	// How far the field moves in one screen pixel, the shader smooths
+	// the outline over that range
+	Math::Vector3f normal;
+	if (distanceField) {
+		normal.x = 0.5f / (spread * Scale);
+	}
+
+	const ShapedRun& Run = face.shaper.Shape(text, length);
+
+	// Make every glyph resident before emitting anything
+	if (layout) {
+		pagesUsed = MakeResident(face, Run, position.x, Scale, &layout->keys, &layout->complete);
+	}
+	else {
+		pagesUsed = MakeResident(face, Run, position.x, Scale, nullptr, nullptr);
+	}
+
+	const size_t DroppedQuads = spriteRenderer.overflowStats.droppedQuads;
+
+	// Then emit the run once per page it touches, so each page costs a
+	// single render call
+	for (uint16_t page = 0; pagesUsed != 0; page++, pagesUsed >>= 1) {
+		if (!(pagesUsed & 1)) {
+			continue;
+		}
+
+		const uint32_t FirstVertex = spriteRenderer.vbCursor;
+
+		spriteRenderer.BeginBatch(atlas.pages[page]->texture, Shader);
+		PushRunQuads(face, Run, page, position, color, normal, Scale);
+		spriteRenderer.EndBatch();
+
+		// Keep a copy of what was just generated to replay next time
+		if (layout && spriteRenderer.vbCursor != FirstVertex) {
+			CachedLayout::Batch batch;
+			batch.page = page;
+			batch.firstVertex = layout->vertices.size();
+			batch.numQuads = (spriteRenderer.vbCursor - FirstVertex) / 4;
+
+			layout->vertices.insert(
+				layout->vertices.end(),
+				spriteRenderer.vertices + FirstVertex,
+				spriteRenderer.vertices + spriteRenderer.vbCursor
+			);
+			layout->batches.push_back(batch);
+		}
+	}
+
+	// Evictions while laying this string out moved the generation along.
+	// A string that didn't fit in the sprite buffers isn't replayed cut short.
+	if (layout) {
+		layout->generation = atlasGeneration;
+
+		if (spriteRenderer.overflowStats.droppedQuads != DroppedQuads) {
+			layout->complete = false;
+		}
+	}
+}
+
+void TextRenderer::WriteStrings(const TextRun* runs, size_t numRuns) {
+	const SpriteShader Shader = GetShader();
+	uint32_t quadsPerPage[GlyphAtlas::MaxPages] = {};
+	uint32_t pagesUsed = 0;
+
+	batchQuads.clear();
+
+	// Place every glyph of every run. Glyphs stamped for this frame can't
+	// be evicted by later runs, so the texture coordinates stay good.
+	for (size_t r = 0; r < numRuns; r++) {
+		const TextRun& Run = runs[r];
+
+		if (Run.face >= faces.size()) {
+			continue;
+		}
+
+		FontFace& face = *faces[Run.face];
+		const float Size = (Run.size > 0) ? Run.size : (float)face.fontSize;
+		const float Scale = Size / face.fontSize;
+
+		Math::Vector3f normal;
+		if (distanceField) {
+			normal.x = 0.5f / (spread * Scale);
+		}
+
+		if (codepoints.size() < Run.length) {
+			codepoints.resize(Run.length);
+		}
+
+		const size_t Count = Unicode::DecodeUtf8(Run.text, Run.length, codepoints.data());
+
+		// A screen of labels easily outnumbers the runs the shaper keeps,
+		// so they're shaped in place instead of churning its cache
+		face.shaper.ShapeUncached(codepoints.data(), Count, batchRun);
+		pagesUsed |= MakeResident(face, batchRun, Run.position.x, Scale, nullptr, nullptr);
+
+		for (const ShapedGlyph& shaped : batchRun.glyphs) {
+			float x = Run.position.x / Scale + shaped.x;
+			const Glyph* glyph = glyphs.Find(SnapToPhase(face, shaped.key, x));
+
+			if (!glyph || glyph->w == 0) {
+				continue;
+			}
+
+			BatchQuad quad;
+			quad.page = glyph->page;
+			quad.src = Math::Vector4f(glyph->u0, glyph->v0, glyph->u1, glyph->v1);
+			quad.dst = Math::Vector4f(
+				(x + glyph->offsetX) * Scale,
+				Run.position.y + (shaped.y + glyph->offsetY) * Scale,
+				glyph->width * Scale,
+				glyph->height * Scale
+			);
+			quad.color = Run.color;
+			quad.normal = normal;
+
+			batchQuads.push_back(quad);
+			quadsPerPage[glyph->page]++;
+		}
+	}
+
+	// Then fill each page's reserved vertices in one pass over the quads
+	for (uint16_t page = 0; pagesUsed != 0; page++, pagesUsed >>= 1) {
+		if (!(pagesUsed & 1) || quadsPerPage[page] == 0) {
+			continue;
+		}
+
+		size_t numQuads = quadsPerPage[page];
+
+		spriteRenderer.BeginBatch(atlas.pages[page]->texture, Shader);
+		SpriteVertex* vertices = spriteRenderer.ReserveQuads(numQuads);
+
+		for (size_t i = 0, written = 0; written < numQuads; i++) {
+			const BatchQuad& Quad = batchQuads[i];
+
+			if (Quad.page == page) {
+				BuildQuadVertices(Quad.src, Quad.dst, Quad.color, Quad.normal, &vertices[written * 4]);
+				written++;
+			}
+		}
+
+		spriteRenderer.EndBatch();
+	}
+}
+
+void TextRenderer::MeasureString(const char* message, size_t length, TextExtents& out, Math::Vector2f* carets, size_t maxCarets) {
+	MeasureString(message, length, (float)GetFace().fontSize, out, carets, maxCarets);
+}
+
+void TextRenderer::MeasureString(const char* message, size_t length, float size, TextExtents& out, Math::Vector2f* carets, size_t maxCarets) {
+	FontFace& face = GetFace();
+	const float Scale = size / face.fontSize;
+	uint32_t chunk[MeasureChunkSize];
+	MeasurePen pen;
+
+	// Decoded a piece at a time instead of into codepoints, which would
+	// have to grow for long strings
+	for (size_t offset = 0; offset < length;) {
+		const size_t Count = Unicode::TrimUtf8(message + offset, length - offset, MeasureChunkSize);
+
+		const size_t Decoded = Unicode::DecodeUtf8(message + offset, Count, chunk);
+		MeasureChunk(face.metrics, chunk, Decoded, Scale, pen, carets, maxCarets);
+		offset += Count;
+	}
+
+	FinishMeasure(face.metrics, Scale, pen, out, carets, maxCarets);
+}
+
+void TextRenderer::MeasureCodepoints(const uint32_t* text, size_t length, float size, TextExtents& out, Math::Vector2f* carets, size_t maxCarets) {
+	FontFace& face = GetFace();
+	const float Scale = size / face.fontSize;
+	MeasurePen pen;
+
+	MeasureChunk(face.metrics, text, length, Scale, pen, carets, maxCarets);
+	FinishMeasure(face.metrics, Scale, pen, out, carets, maxCarets);
+}
+
+void TextRenderer::PushRunQuads(const FontFace& face, const ShapedRun& run, uint16_t page, Math::Vector2f origin, Math::Vector3f color, Math::Vector3f normal, float scale) {
+	for (const ShapedGlyph& shaped : run.glyphs) {
+		float x = origin.x / scale + shaped.x;
+		const Glyph* glyph = glyphs.Find(SnapToPhase(face, shaped.key, x));
+
+		if (!glyph || glyph->page != page || glyph->w == 0) {
+			continue;
+		}
+
+		const Math::Vector4f Src(glyph->u0, glyph->v0, glyph->u1, glyph->v1);
+		const Math::Vector4f Dst(
+			(x + glyph->offsetX) * scale,
+			origin.y + (shaped.y + glyph->offsetY) * scale,
+			glyph->width * scale,
+			glyph->height * scale
+		);
+
+		spriteRenderer.PushQuad(Src, Dst, color, normal);
+	}
+}
+
+void TextRenderer::DrawParagraph(Paragraph& paragraph, Math::Vector2f position, Math::Vector3f color) {
+	DrawParagraph(paragraph, position, color, (float)paragraph.face.fontSize);
+}
+
+void TextRenderer::DrawParagraph(Paragraph& paragraph, Math::Vector2f position, Math::Vector3f color, float size) {
+	const FontFace& Face = paragraph.face;
+	uint32_t pagesUsed = 0;
+	const float Scale = size / Face.fontSize;
+	const SpriteShader Shader = GetShader();
+
+	Math::Vector3f normal;
+	if (distanceField) {
+		normal.x = 0.5f / (spread * Scale);
+	}
+
+	for (const ParagraphLine& line : paragraph.lines) {
+		pagesUsed |= MakeResident(Face, line.run, position.x + paragraph.GetLineOffset(line) * Scale, Scale, nullptr, nullptr);
+	}
+
+	// Like WriteCodepoints, one render call per page for all the lines
+	for (uint16_t page = 0; pagesUsed != 0; page++, pagesUsed >>= 1) {
+		if (!(pagesUsed & 1)) {
+			continue;
+		}
+
+		spriteRenderer.BeginBatch(atlas.pages[page]->texture, Shader);
+
+		for (size_t i = 0; i < paragraph.lines.size(); i++) {
+			const ParagraphLine& line = paragraph.lines[i];
+			const Math::Vector2f Origin(
+				position.x + paragraph.GetLineOffset(line) * Scale,
+				position.y - (float)i * Face.metrics.lineHeight * Scale
+			);
+
+			PushRunQuads(Face, line.run, page, Origin, color, normal, Scale);
+		}
+
+		spriteRenderer.EndBatch();
+	}
+}
+
+void TextRenderer::DrawDocument(Document& document, Math::Vector2f position, Math::Vector3f color, double scrollY, float height) {
+	DrawDocument(document, position, color, scrollY, height, (float)GetFace().fontSize);
+}
+
+void TextRenderer::DrawDocument(Document& document, Math::Vector2f position, Math::Vector3f color, double scrollY, float height, float size) {
+	FontFace& face = GetFace();
+	const float Scale = size / face.fontSize;
+	const float LineHeight = face.metrics.lineHeight * Scale;
+	const SpriteShader Shader = GetShader();
+
+	if (document.NumLines() == 0 || LineHeight <= 0) {
+		return;
+	}
+
+	// Lines partly inside the viewport count
+	size_t first = (scrollY > 0) ? (size_t)(scrollY / LineHeight) : 0;
+	size_t last = (size_t)((std::max(scrollY, 0.0) + height) / LineHeight) + 1;
+
+	first = std::min(first, document.NumLines());
+	last = std::min(last, document.NumLines());
+
+	Math::Vector3f normal;
+	if (distanceField) {
+		normal.x = 0.5f / (spread * Scale);
+	}
+
+	// Runs are copied out, the shaper's reference only lasts until the
+	// next line. Lines still on screen from the last frame hit its cache.
+	if (documentRuns.size() < last - first) {
+		documentRuns.resize(last - first);
+	}
+
+	uint32_t pagesUsed = 0;
+
+	for (size_t i = first; i < last; i++) {
+		size_t length;
+		const char* line = document.GetLine(i, length);
+		length = Unicode::TrimUtf8(line, length, MaxDocumentLineBytes);
+
+		if (codepoints.size() < length) {
+			codepoints.resize(length);
+		}
+
+		const size_t Count = Unicode::DecodeUtf8(line, length, codepoints.data());
+		ShapedRun& run = documentRuns[i - first];
+
+		run.glyphs = face.shaper.Shape(codepoints.data(), Count).glyphs;
+		pagesUsed |= MakeResident(face, run, position.x, Scale, nullptr, nullptr);
+	}
+
+	// Runs start at the bottom of their line. Lines are placed relative to
+	// the scroll in double, so only their small offset on screen is a float.
+	const float BaselineOffset = (face.metrics.ascender - face.metrics.descender) * Scale;
+
+	for (uint16_t page = 0; pagesUsed != 0; page++, pagesUsed >>= 1) {
+		if (!(pagesUsed & 1)) {
+			continue;
+		}
+
+		spriteRenderer.BeginBatch(atlas.pages[page]->texture, Shader);
+
+		for (size_t i = first; i < last; i++) {
+			const Math::Vector2f Origin(position.x, position.y - (float)((double)i * LineHeight - scrollY) - BaselineOffset);
+
+			PushRunQuads(face, documentRuns[i - first], page, Origin, color, normal, Scale);
+		}
+
+		spriteRenderer.EndBatch();
+	}
+}
+
+uint32_t TextRenderer::MakeResident(const FontFace& face, const ShapedRun& run, float originX, float scale, std::vector<uint32_t>* keys, bool* complete) {
+	uint32_t pagesUsed = 0;
+
+	// Stamping a glyph with the current frame keeps it from being evicted
+	// by the ones after
+	for (const ShapedGlyph& shaped : run.glyphs) {
+		float x = originX / scale + shaped.x;
+		const uint32_t Key = SnapToPhase(face, shaped.key, x);
+		Glyph* glyph = glyphs.Find(Key);
+
+		subpixelStats.lookups[GetGlyphPhase(Key)]++;
+
+		if (glyph) {
+			cacheStats.hits++;
+		}
+		else {
+			cacheStats.misses++;
+
+			auto failed = failedGlyphs.find(Key);
+			const bool Retry = failed == failedGlyphs.end() || (int32_t)(spriteRenderer.frameIndex - failed->second) >= 0;
+
+			// Leave it to the background thread, the glyph shows up
+			// once it has been committed
+			if (Retry && face.asyncRasterizer) {
+				face.asyncRasterizer->Request(Key);
+			}
+
+			// Glyphs that don't fit in the atlas anymore are skipped, and
+			// left alone for a while before they're tried again
+			if (!Retry || face.asyncRasterizer || !AddCharacter(Key)) {
+				if (Retry && !face.asyncRasterizer) {
+					failedGlyphs[Key] = spriteRenderer.frameIndex + FailedGlyphRetryFrames;
+				}
+
+				if (complete) {
+					*complete = false;
+				}
+				continue;
+			}
+
+			if (failed != failedGlyphs.end()) {
+				failedGlyphs.erase(failed);
+			}
+			glyph = glyphs.Find(Key);
+		}
+
+		glyph->lastUsedFrame = spriteRenderer.frameIndex;
+		pagesUsed |= 1u << glyph->page;
+
+		if (keys) {
+			keys->push_back(Key);
+		}
+	}
+
+	// Stamping each glyph once is enough on replay
+	if (keys) {
+		std::sort(keys->begin(), keys->end());
+		keys->erase(std::unique(keys->begin(), keys->end()), keys->end());
+	}
+
+	return pagesUsed;
+}
+
+uint32_t TextRenderer::SnapToPhase(const FontFace& face, uint32_t key, float& x) const {
+	const uint32_t Key = SetGlyphFace(key, face.id);
+
+	if (face.subpixelPositions <= 1) {
+		return Key;
+	}
+
+	// Nearest phase, rounding up past the last one lands on phase 0 of
+	// the next pixel
+	const float Whole = floorf(x);
+	int phase = (int)((x - Whole) * face.subpixelPositions + 0.5f);
+
+	x = Whole;
+	if (phase == face.subpixelPositions) {
+		x += 1;
+		phase = 0;
+	}
+
+	return SetGlyphPhase(Key, (uint8_t)phase);
+}
+
+void TextRenderer::SetText(TextBlock& block, const char* message, size_t length) {
+	SetText(block, message, length, (float)GetFace().fontSize);
+}
+
+void TextRenderer::SetText(TextBlock& block, const char* message, size_t length, float size) {
+	if (codepoints.size() < length) {
+		codepoints.resize(length);
+	}
+
+	const size_t Count = Unicode::DecodeUtf8(message, length, codepoints.data());
+
+	if (block.size == size && block.face == currentFace && block.text.size() == Count &&
+		std::equal(codepoints.begin(), codepoints.begin() + Count, block.text.begin())) {
+		return;
+	}
+
+	block.text.assign(codepoints.begin(), codepoints.begin() + Count);
+	block.size = size;
+	block.face = currentFace;
+	block.dirty = true;
+	block.retryDelay = 0;
+}
+
+void TextRenderer::BuildTextBlock(TextBlock& block) {
+	FontFace& face = *faces[block.face];
+	const float Scale = block.size / face.fontSize;
+	const ShapedRun& Run = face.shaper.Shape(block.text.data(), block.text.size());
+	const Math::Vector3f White(1, 1, 1);
+
+	Math::Vector3f normal;
+	if (distanceField) {
+		normal.x = 0.5f / (spread * Scale);
+	}
+
+	block.complete = true;
+	block.keys.clear();
+	block.batches.clear();
+	blockVertices.clear();
+	blockIndices.clear();
+
+	uint32_t pagesUsed = MakeResident(face, Run, 0, Scale, &block.keys, &block.complete);
+
+	block.placements.resize(block.keys.size());
+	for (size_t i = 0; i < block.keys.size(); i++) {
+		const Glyph* glyph = glyphs.Find(block.keys[i]);
+		block.placements[i] = glyph ? glyph->placement : 0;
+	}
+
+	// Laid out at the origin in white, DrawTextBlock moves and tints it
+	for (uint16_t page = 0; pagesUsed != 0; page++, pagesUsed >>= 1) {
+		if (!(pagesUsed & 1)) {
 			continue;
 		}
 
-		if (it == clips.end()) {
-			AddCharacter(c);
+		TextBlock::Batch batch;
+		batch.page = page;
+		batch.firstIndex = (uint32_t)blockIndices.size();
+
+		for (const ShapedGlyph& shaped : Run.glyphs) {
+			float x = shaped.x;
+			const Glyph* glyph = glyphs.Find(SnapToPhase(face, shaped.key, x));
+
+			if (!glyph || glyph->page != page || glyph->w == 0) {
+				continue;
+			}
+
+			// 16-bit indices, whatever doesn't fit is dropped
+			if (blockVertices.size() + 4 > 0x10000) {
+				break;
+			}
+
+			const uint16_t Base = (uint16_t)blockVertices.size();
+			const Math::Vector4f Src(glyph->u0, glyph->v0, glyph->u1, glyph->v1);
+			const Math::Vector4f Dst(
+				(x + glyph->offsetX) * Scale,
+				(shaped.y + glyph->offsetY) * Scale,
+				glyph->width * Scale,
+				glyph->height * Scale
+			);
+
+			blockVertices.resize(Base + 4);
+			BuildQuadVertices(Src, Dst, White, normal, &blockVertices[Base]);
+
+			const uint16_t QuadIndices[] = { 0, 1, 2, 2, 0, 3 };
+			for (uint16_t index : QuadIndices) {
+				blockIndices.push_back(Base + index);
+			}
+		}
+
+		batch.numIndices = (uint32_t)blockIndices.size() - batch.firstIndex;
+
+		if (batch.numIndices > 0) {
+			block.batches.push_back(batch);
+		}
+	}
+
+	if (!block.vertexBuffer) {
+		glGenBuffers(1, &block.vertexBuffer);
+		glGenBuffers(1, &block.indexBuffer);
+	}
+
+	glBindBuffer(GL_ARRAY_BUFFER, block.vertexBuffer);
+	glBufferData(GL_ARRAY_BUFFER, blockVertices.size() * sizeof(SpriteVertex), blockVertices.data(), GL_STATIC_DRAW);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, block.indexBuffer);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, blockIndices.size() * sizeof(uint16_t), blockIndices.data(), GL_STATIC_DRAW);
+
+	block.dirty = false;
+
+	// Glyphs that couldn't be placed usually still can't be next frame, so
+	// wait twice as long after each incomplete build
+	if (block.complete) {
+		block.retryDelay = 0;
+	}
+	else {
+		const uint32_t MaxRetryDelay = 64;
+
+		block.retryDelay = block.retryDelay ? std::min(block.retryDelay * 2, MaxRetryDelay) : 1;
+		block.retryFrame = spriteRenderer.frameIndex + block.retryDelay;
+	}
+}
+
+void TextRenderer::DrawTextBlock(TextBlock& block, Math::Vector2f position, Math::Vector3f color) {
+	bool rebuild = block.dirty || (!block.complete && (int32_t)(spriteRenderer.frameIndex - block.retryFrame) >= 0);
+
+	// Only evictions that took one of its own glyphs invalidate the block
+	for (size_t i = 0; i < block.keys.size() && !rebuild; i++) {
+		Glyph* glyph = glyphs.Find(block.keys[i]);
+
+		if (!glyph || glyph->placement != block.placements[i]) {
+			rebuild = true;
 		}
-		auto& clip = clips[c];
+		else {
+			glyph->lastUsedFrame = spriteRenderer.frameIndex;
+		}
+	}
 
-		Math::Vector4f src;
-		Math::Vector4f dst;
+	if (rebuild) {
+		BuildTextBlock(block);
+	}
 
-		// Calculate the texture coordinates for the graphics backend
-		src.x = (float)clip.x / cacheSurface->w;
-		src.y = (float)clip.y / cacheSurface->h;
-		src.z = (float)(clip.x + clip.w) / cacheSurface->w;
-		src.w = (float)(clip.y + clip.h) / cacheSurface->h;
+	const GLuint Program = spriteRenderer.programs[(size_t)GetShader()];
 
-		// Calculate the destination to render to the screen
-		dst.x = position.x + x;
-		dst.y = position.y + y;
-		dst.z = clip.w;
-		dst.w = clip.h;
+	for (const TextBlock::Batch& batch : block.batches) {
+		RenderCall call;
 
-		spriteRenderer.PushSprite(cacheTexture, src, dst, color);
+		call.texture = atlas.pages[batch.page]->texture.textureHandle;
+		call.vertexBuffer = block.vertexBuffer;
+		call.indexBuffer = block.indexBuffer;
+		call.program = Program;
+		call.indexBase = batch.firstIndex * sizeof(uint16_t);
+		call.numVertices = batch.numIndices;
+		call.translation = position;
+		call.color = color;
+		call.blend = spriteRenderer.blendMode;
 
-		x += clip.w + PaddingX;
+		spriteRenderer.PushRenderCall(call);
+	}
+}
+
+SpriteShader TextRenderer::GetShader() const {
+	if (distanceField) {
+		return SpriteShader::DistanceField;
+	}
+
+	return (atlas.desc.format == TextureFormat::Alpha8) ? SpriteShader::Alpha : SpriteShader::Rgba;
+}
+
+TextRenderer::CachedLayout* TextRenderer::FindLayout(uint64_t hash, Math::Vector2f position, Math::Vector3f color, const uint32_t* text, size_t length, float size, uint8_t face) {
+	auto it = layoutLookup.find(hash);
+
+	if (it == layoutLookup.end()) {
+		return nullptr;
+	}
+
+	CachedLayout& layout = *it->second;
+
+	// A different string with the same hash takes over the entry
+	if (layout.text.size() != length || !std::equal(text, text + length, layout.text.begin()) ||
+		layout.position.x != position.x || layout.position.y != position.y ||
+		layout.color.x != color.x || layout.color.y != color.y || layout.color.z != color.z ||
+		layout.size != size || layout.face != face) {
+		layouts.erase(it->second);
+		layoutLookup.erase(it);
+		return nullptr;
+	}
+
+	layouts.splice(layouts.begin(), layouts, it->second);
+	return &layout;
+}
+
+TextRenderer::CachedLayout& TextRenderer::RecycleLayout(uint64_t hash) {
+	// The least recently used entry is reused once the cache is full,
+	// its vectors keep their capacity
+	if (layouts.size() >= layoutCapacity) {
+		layoutLookup.erase(layouts.back().hash);
+		layouts.splice(layouts.begin(), layouts, std::prev(layouts.end()));
+	}
+	else {
+		layouts.push_front(CachedLayout());
+	}
+
+	layouts.front().hash = hash;
+	layoutLookup[hash] = layouts.begin();
+
+	return layouts.front();
+}
+
+void TextRenderer::ReplayLayout(const CachedLayout& layout) {
+	const SpriteShader Shader = GetShader();
+
+	for (uint32_t key : layout.keys) {
+		Glyph* glyph = glyphs.Find(key);
+
+		if (glyph) {
+			glyph->lastUsedFrame = spriteRenderer.frameIndex;
+		}
+	}
+
+	for (const CachedLayout::Batch& batch : layout.batches) {
+		spriteRenderer.BeginBatch(atlas.pages[batch.page]->texture, Shader);
+		spriteRenderer.PushQuads(&layout.vertices[batch.firstVertex], batch.numQuads);
+		spriteRenderer.EndBatch();
 	}
 }
 
 void TextRenderer::UpdateTexture() {
-	glBindTexture(GL_TEXTURE_2D, cacheTexture.textureHandle);
-
-	glTexSubImage2D(
-		GL_TEXTURE_2D,
-		0,
-		0,
-		0,
-		(GLsizei)cacheTexture.desc.width,
-		(GLsizei)cacheTexture.desc.height,
-		GL_RGBA,
-		GL_UNSIGNED_BYTE,
-		cacheSurface->pixels
-	);
-
-	glBindTexture(GL_TEXTURE_2D, 0);
+	CommitFinishedGlyphs();
+	atlas.Upload();
+}
+
+void TextRenderer::CommitFinishedGlyphs() {
+	for (FontFace* face : faces) {
+		if (!face->asyncRasterizer) {
+			continue;
+		}
+
+		face->asyncRasterizer->Poll(finishedGlyphs);
+
+		for (const GlyphBitmap& bitmap : finishedGlyphs) {
+			// A synchronous AddCharacter or Prewarm may have beaten the worker
+			if (glyphs.Find(bitmap.codepoint)) {
+				continue;
+			}
+
+			if (CommitGlyph(bitmap)) {
+				failedGlyphs.erase(bitmap.codepoint);
+			}
+			else {
+				failedGlyphs[bitmap.codepoint] = spriteRenderer.frameIndex + FailedGlyphRetryFrames;
+			}
+		}
+	}
+}
+
+const Glyph* TextRenderer::FindCandidate(EvictionCandidate& candidate) {
+	if (candidate.key == GlyphTable::NoCodepoint) {
+		return nullptr;
+	}
+
+	const Glyph* glyph = glyphs.Find(candidate.key);
+
+	// Drawn again or evicted since the queue was built
+	if (!glyph || glyph->lastUsedFrame != candidate.lastUsedFrame) {
+		candidate.key = GlyphTable::NoCodepoint;
+		return nullptr;
+	}
+
+	return glyph;
+}
+
+AtlasRect TextRenderer::Evict(uint32_t key, uint16_t& page) {
+	const Glyph* glyph = glyphs.Find(key);
+
+	AtlasRect slot;
+	slot.x = glyph->x;
+	slot.y = glyph->y;
+	slot.w = glyph->slotW;
+	slot.h = glyph->slotH;
+	page = glyph->page;
+
+	atlas.Clear(page, slot);
+	glyphs.Erase(key);
+	cacheStats.evictions++;
+	atlasGeneration++;
+
+	return slot;
+}
+
+bool TextRenderer::EvictFor(uint16_t w, uint16_t h, AtlasRect& out, uint16_t& page) {
+	const uint32_t FrameIndex = spriteRenderer.frameIndex;
+
+	// Glyphs drawn this frame are still referenced by the sprite batch and
+	// must stay put. So are last frame's, glyphs committed in UpdateTexture
+	// land after BuildCommandList already moved on to the next frame. That
+	// holds for the whole frame, so the queue does too.
+	if (evictionFrame != FrameIndex) {
+		evictionQueue.clear();
+		evictionCursor = 0;
+		evictionFrame = FrameIndex;
+
+		glyphs.ForEach([&](const Glyph& glyph) {
+			if (FrameIndex - glyph.lastUsedFrame > 1 && glyph.slotW > 0 && glyph.slotH > 0) {
+				evictionQueue.push_back({ glyph.codepoint, glyph.lastUsedFrame, (uint32_t)glyph.slotW * glyph.slotH });
+			}
+		});
+
+		// Oldest first, the smaller slot first among glyphs as old
+		std::sort(evictionQueue.begin(), evictionQueue.end(), [](const EvictionCandidate& a, const EvictionCandidate& b) {
+			return a.lastUsedFrame != b.lastUsedFrame ? a.lastUsedFrame < b.lastUsedFrame : a.area < b.area;
+		});
+	}
+
+	while (evictionCursor < evictionQueue.size() && evictionQueue[evictionCursor].key == GlyphTable::NoCodepoint) {
+		evictionCursor++;
+	}
+
+	// The least recently used glyph whose slot is big enough
+	for (size_t i = evictionCursor; i < evictionQueue.size(); i++) {
+		const Glyph* glyph = FindCandidate(evictionQueue[i]);
+
+		if (glyph && glyph->slotW >= w && glyph->slotH >= h) {
+			out = Evict(glyph->codepoint, page);
+			evictionQueue[i].key = GlyphTable::NoCodepoint;
+			return true;
+		}
+	}
+
+	// Otherwise a w * h area starting at one of the oldest glyphs, when
+	// every glyph in it may go. Finding them walks the whole table, so
+	// only a few areas are tried.
+	size_t areasTried = 0;
+
+	for (size_t i = evictionCursor; i < evictionQueue.size() && areasTried < MaxAreasPerGlyph; i++) {
+		const Glyph* anchor = FindCandidate(evictionQueue[i]);
+
+		if (!anchor) {
+			continue;
+		}
+
+		areasTried++;
+
+		// Pulled back so the area stays on the page, skipped if it can't
+		const int AreaX = std::min<int>(anchor->x, (int)atlas.desc.width - w);
+		const int AreaY = std::min<int>(anchor->y, (int)atlas.desc.height - h);
+
+		if (AreaX < 0 || AreaY < 0) {
+			continue;
+		}
+
+		AtlasRect area;
+		area.x = (uint16_t)AreaX;
+		area.y = (uint16_t)AreaY;
+		area.w = w;
+		area.h = h;
+
+		const uint16_t AreaPage = anchor->page;
+		bool clear = true;
+
+		evictionVictims.clear();
+		glyphs.ForEach([&](const Glyph& glyph) {
+			if (!clear || glyph.page != AreaPage ||
+				glyph.x >= area.x + area.w || glyph.x + glyph.slotW <= area.x ||
+				glyph.y >= area.y + area.h || glyph.y + glyph.slotH <= area.y) {
+				return;
+			}
+
+			if (FrameIndex - glyph.lastUsedFrame <= 1 || evictionVictims.size() == MaxVictimsPerGlyph) {
+				clear = false;
+				return;
+			}
+
+			evictionVictims.push_back(glyph.codepoint);
+		});
+
+		if (!clear) {
+			continue;
+		}
+
+		// The victims' slots go back to the packer whole, then the area is
+		// taken out of them and whatever free space it covers
+		AtlasPacker* packer = atlas.pages[AreaPage]->packer;
+
+		for (uint32_t key : evictionVictims) {
+			uint16_t victimPage;
+			packer->Free(Evict(key, victimPage));
+		}
+
+		packer->Reserve(area);
+
+		out = area;
+		page = AreaPage;
+		return true;
+	}
+
+	return false;
+}
+
+void TextRenderer::SetGlyphMetrics(Glyph& glyph, int16_t bearingX, int16_t bearingY, uint16_t advance) const {
+	glyph.u0 = (float)glyph.x / atlas.desc.width;
+	glyph.v0 = (float)glyph.y / atlas.desc.height;
+	glyph.u1 = (float)(glyph.x + glyph.w) / atlas.desc.width;
+	glyph.v1 = (float)(glyph.y + glyph.h) / atlas.desc.height;
+	glyph.offsetX = bearingX;
+	glyph.offsetY = bearingY;
+	glyph.width = glyph.w;
+	glyph.height = glyph.h;
+	glyph.advance = advance;
+}
+
+// Everything that decides what the cached pixels look like
+static GlyphCacheHeader MakeCacheHeader(const TextRenderer& renderer) {
+	GlyphCacheHeader header = {};
+
+	header.magic = GlyphCacheMagic;
+	header.version = GlyphCacheVersion;
+	header.fontHash = 0xCBF29CE484222325ull;
+	for (const FontFace* face : renderer.faces) {
+		const uint32_t SizeAndStyle[] = { (uint32_t)face->fontSize, (uint32_t)face->style, face->subpixelPositions };
+
+		for (const FontSource& source : face->fonts.fonts) {
+			header.fontHash = HashBuffer(source.buffer, source.size, header.fontHash);
+		}
+		header.fontHash = HashBuffer(SizeAndStyle, sizeof(SizeAndStyle), header.fontHash);
+	}
+	header.fontSize = (uint32_t)renderer.faces[0]->fontSize;
+	header.spread = renderer.spread;
+	header.format = (uint32_t)renderer.atlas.desc.format;
+	header.padding = TextRenderer::PaddingX | (TextRenderer::PaddingY << 16);
+	header.pageWidth = (uint32_t)renderer.atlas.desc.width;
+	header.pageHeight = (uint32_t)renderer.atlas.desc.height;
+
+	return header;
+}
+
+bool TextRenderer::SaveCache(const char* path) {
+	GlyphCacheHeader header = MakeCacheHeader(*this);
+	const size_t PageSize = atlas.pitch * atlas.desc.height;
+
+	header.numPages = (uint32_t)atlas.pages.size();
+	header.numGlyphs = (uint32_t)glyphs.Size();
+
+	// Written next to the target and renamed over it, so a crash halfway
+	// through never leaves a truncated cache behind
+	std::string tempPath = std::string(path) + ".tmp";
+	std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+
+	if (!file) {
+		return false;
+	}
+
+	file.write((const char*)&header, sizeof(header));
+
+	glyphs.ForEach([&](const Glyph& glyph) {
+		GlyphCacheRecord record = {};
+
+		record.codepoint = glyph.codepoint;
+		record.x = glyph.x;
+		record.y = glyph.y;
+		record.w = glyph.w;
+		record.h = glyph.h;
+		record.slotW = glyph.slotW;
+		record.slotH = glyph.slotH;
+		record.page = glyph.page;
+		record.bearingX = (int16_t)glyph.offsetX;
+		record.bearingY = (int16_t)glyph.offsetY;
+		record.advance = (uint16_t)glyph.advance;
+
+		file.write((const char*)&record, sizeof(record));
+	});
+
+	for (const GlyphAtlasPage* page : atlas.pages) {
+		file.write((const char*)page->pixels, PageSize);
+	}
+
+	file.close();
+
+	if (!file) {
+		std::remove(tempPath.c_str());
+		return false;
+	}
+
+#ifdef _WIN32
+	// rename won't replace an existing file on Windows
+	std::remove(path);
+#endif
+
+	return std::rename(tempPath.c_str(), path) == 0;
+}
+
+bool TextRenderer::LoadCache(const char* path) {
+	Utility::MappedFile file;
+
+	if (!glyphs.Empty() || !Utility::MapFile(path, file)) {
+		return false;
+	}
+
+	GlyphCacheHeader header;
+	GlyphCacheHeader expected = MakeCacheHeader(*this);
+	const size_t PageSize = atlas.pitch * atlas.desc.height;
+
+	if (file.size < sizeof(header)) {
+		Utility::UnmapFile(file);
+		return false;
+	}
+
+	memcpy(&header, file.data, sizeof(header));
+
+	const size_t RecordsSize = sizeof(GlyphCacheRecord) * header.numGlyphs;
+	const bool Matches =
+		header.magic == expected.magic &&
+		header.version == expected.version &&
+		header.fontHash == expected.fontHash &&
+		header.fontSize == expected.fontSize &&
+		header.spread == expected.spread &&
+		header.format == expected.format &&
+		header.padding == expected.padding &&
+		header.pageWidth == expected.pageWidth &&
+		header.pageHeight == expected.pageHeight &&
+		header.numPages <= atlas.desc.maxPages &&
+		file.size == sizeof(header) + RecordsSize + PageSize * header.numPages;
+
+	if (!Matches) {
+		Utility::UnmapFile(file);
+		return false;
+	}
+
+	std::vector<GlyphCacheRecord> records(header.numGlyphs);
+	const uint8_t* pixels = file.data + sizeof(header) + RecordsSize;
+
+	if (RecordsSize > 0) {
+		memcpy(records.data(), file.data + sizeof(header), RecordsSize);
+	}
+
+	// A single glyph outside its page or slot, or clashing with another,
+	// means the file can't be trusted, so it's checked in full before
+	// anything is loaded
+	for (const GlyphCacheRecord& record : records) {
+		const bool Valid =
+			record.codepoint != GlyphTable::NoCodepoint &&
+			record.page < header.numPages &&
+			record.w <= record.slotW &&
+			record.h <= record.slotH &&
+			(size_t)record.x + record.slotW <= header.pageWidth &&
+			(size_t)record.y + record.slotH <= header.pageHeight;
+
+		if (!Valid) {
+			Utility::UnmapFile(file);
+			return false;
+		}
+	}
+
+	if (HasConflictingRecords(records)) {
+		Utility::UnmapFile(file);
+		return false;
+	}
+
+	// The pixels are uploaded straight from the mapping, the copy is
+	// only kept for glyphs added later on
+	for (uint32_t i = 0; i < header.numPages; i++) {
+		if (i == atlas.pages.size()) {
+			atlas.AddPage();
+		}
+
+		GlyphAtlasPage* page = atlas.pages[i];
+		const uint8_t* PagePixels = pixels + PageSize * i;
+
+		memcpy(page->pixels, PagePixels, PageSize);
+		UpdateGraphicsTexture(page->texture, 0, 0, atlas.desc.width, atlas.desc.height, PagePixels);
+		page->numDirtyRects = 0;
+	}
+
+	for (const GlyphCacheRecord& record : records) {
+		Glyph& glyph = glyphs.Insert(record.codepoint);
+		glyph.x = record.x;
+		glyph.y = record.y;
+		glyph.w = record.w;
+		glyph.h = record.h;
+		glyph.slotW = record.slotW;
+		glyph.slotH = record.slotH;
+		glyph.page = record.page;
+		glyph.placement = ++numPlacements;
+		SetGlyphMetrics(glyph, record.bearingX, record.bearingY, record.advance);
+
+		AtlasRect slot;
+		slot.x = glyph.x;
+		slot.y = glyph.y;
+		slot.w = glyph.slotW;
+		slot.h = glyph.slotH;
+		atlas.pages[glyph.page]->packer->Reserve(slot);
+	}
+
+	Utility::UnmapFile(file);
+	return true;
 }
\ No newline at end of file
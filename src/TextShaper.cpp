@@ -0,0 +1,189 @@
+#include "TextShaper.hpp"
+#include "GlyphRasterizer.hpp"
+#include <algorithm>
+#include <iterator>
+
+// FNV-1a over the codepoints
+static uint64_t HashText(const uint32_t* text, size_t length) {
+	uint64_t hash = 0xCBF29CE484222325ull;
+
+	for (size_t i = 0; i < length; i++) {
+		hash ^= text[i];
+		hash *= 0x100000001B3ull;
+	}
+
+	return hash;
+}
+
+TextShaper::TextShaper(FontMetrics& metrics, const FontSet& fonts, size_t fontSize, size_t capacity) :
+	metrics(metrics),
+	fonts(fonts),
+	capacity(capacity)
+{
+#ifdef HAS_HARFBUZZ
+	// HarfBuzz reads the tables straight out of the font buffers, the
+	// rasterizer's FreeType faces are left alone
+	for (const FontSource& source : fonts.fonts) {
+		hb_blob_t* blob = hb_blob_create((const char*)source.buffer, (unsigned int)source.size, HB_MEMORY_MODE_READONLY, nullptr, nullptr);
+		hb_face_t* face = hb_face_create(blob, 0);
+		hb_font_t* font = hb_font_create(face);
+
+		// Positions come back in 26.6 fixed point pixels
+		hb_font_set_scale(font, (int)fontSize * 64, (int)fontSize * 64);
+
+		blobs.push_back(blob);
+		faces.push_back(face);
+		hbFonts.push_back(font);
+	}
+
+	buffer = hb_buffer_create();
+#else
+	(void)fontSize;
+#endif
+}
+
+TextShaper::~TextShaper() {
+#ifdef HAS_HARFBUZZ
+	hb_buffer_destroy(buffer);
+
+	for (size_t i = 0; i < hbFonts.size(); i++) {
+		hb_font_destroy(hbFonts[i]);
+		hb_face_destroy(faces[i]);
+		hb_blob_destroy(blobs[i]);
+	}
+#endif
+}
+
+const ShapedRun& TextShaper::Shape(const uint32_t* text, size_t length) {
+	const uint64_t Hash = HashText(text, length);
+	auto it = lookup.find(Hash);
+
+	// The text is compared too, two strings can share a hash
+	if (it != lookup.end()) {
+		Entry& entry = *it->second;
+
+		if (entry.text.size() == length && std::equal(text, text + length, entry.text.begin())) {
+			entries.splice(entries.begin(), entries, it->second);
+			cacheStats.hits++;
+			return entry.run;
+		}
+
+		entries.erase(it->second);
+		lookup.erase(it);
+	}
+
+	cacheStats.misses++;
+
+	// Recycle the least recently used run once the cache is full, its
+	// vectors keep their capacity
+	if (entries.size() >= capacity && !entries.empty()) {
+		lookup.erase(entries.back().hash);
+		entries.splice(entries.begin(), entries, std::prev(entries.end()));
+	}
+	else {
+		entries.push_front(Entry());
+	}
+
+	Entry& entry = entries.front();
+	entry.hash = Hash;
+	entry.text.assign(text, text + length);
+	ShapeUncached(text, length, entry.run);
+	lookup[Hash] = entries.begin();
+
+	return entry.run;
+}
+
+void TextShaper::ShapeUncached(const uint32_t* text, size_t length, ShapedRun& out) {
+	size_t lineStart = 0;
+	float y = 0;
+
+	out.glyphs.clear();
+
+	for (size_t i = 0; i <= length; i++) {
+		if (i == length || text[i] == '\n') {
+			ShapeLine(text + lineStart, i - lineStart, y, out);
+			lineStart = i + 1;
+			y -= metrics.lineHeight;
+		}
+	}
+}
+
+#ifdef HAS_HARFBUZZ
+void TextShaper::ShapeLine(const uint32_t* text, size_t length, float y, ShapedRun& out) {
+	size_t runStart = 0;
+	float x = 0;
+
+	if (hbFonts.empty()) {
+		return;
+	}
+
+	// Split wherever the font changes
+	for (size_t i = 1; i <= length; i++) {
+		if (i < length && fonts.Find(text[i]) == fonts.Find(text[runStart])) {
+			continue;
+		}
+
+		x = ShapeFontRun(fonts.Find(text[runStart]), text + runStart, i - runStart, x, y, out);
+		runStart = i;
+	}
+}
+
+float TextShaper::ShapeFontRun(uint8_t fontIndex, const uint32_t* text, size_t length, float x, float y, ShapedRun& out) {
+	hb_font_t* font = (fontIndex < hbFonts.size()) ? hbFonts[fontIndex] : hbFonts[0];
+
+	hb_buffer_clear_contents(buffer);
+	hb_buffer_add_utf32(buffer, text, (int)length, 0, (int)length);
+	hb_buffer_guess_segment_properties(buffer);
+	hb_shape(font, buffer, nullptr, 0);
+
+	unsigned int count = 0;
+	const hb_glyph_info_t* info = hb_buffer_get_glyph_infos(buffer, &count);
+	const hb_glyph_position_t* positions = hb_buffer_get_glyph_positions(buffer, &count);
+
+	for (unsigned int i = 0; i < count; i++) {
+		ShapedGlyph glyph;
+		const uint32_t C = text[info[i].cluster];
+		hb_codepoint_t nominal = 0;
+
+		// A glyph that is just its codepoint's own keeps the codepoint as
+		// its key, so it shares the atlas entry with unshaped text
+		if (hb_font_get_nominal_glyph(font, C, &nominal) && nominal == info[i].codepoint) {
+			glyph.key = C;
+		}
+		else {
+			glyph.key = MakeGlyphIndexKey(fontIndex, info[i].codepoint);
+		}
+
+		glyph.x = x + positions[i].x_offset / 64.0f;
+		glyph.y = y + positions[i].y_offset / 64.0f;
+		out.glyphs.push_back(glyph);
+
+		x += positions[i].x_advance / 64.0f + metrics.extraAdvance;
+		y += positions[i].y_advance / 64.0f;
+	}
+
+	return x;
+}
+#else
+void TextShaper::ShapeLine(const uint32_t* text, size_t length, float y, ShapedRun& out) {
+	uint32_t previous = 0;
+	float x = 0;
+
+	for (size_t i = 0; i < length; i++) {
+		const uint32_t C = text[i];
+		ShapedGlyph glyph;
+
+		if (metrics.hasKerning) {
+			x += metrics.GetKerning(previous, C);
+		}
+
+		glyph.key = C;
+		glyph.x = x;
+		glyph.y = y;
+		out.glyphs.push_back(glyph);
+
+		x += metrics.GetAdvance(C);
+		previous = C;
+	}
+}
+#endif
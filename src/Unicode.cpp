@@ -0,0 +1,230 @@
+#include "Unicode.hpp"
+#include "Simd.hpp"
+
+// Runs of ASCII (or, for UTF-16, of units without surrogates) are widened
+// a vector at a time, anything else drops to the scalar decoder
+
+namespace Unicode {
+
+// Widens runs of 16 ASCII bytes, returns how many bytes were consumed
+static size_t WidenAscii(const uint8_t* text, size_t length, uint32_t* out) {
+	size_t i = 0;
+
+#if defined(HAS_SSE2)
+	const __m128i Zero = _mm_setzero_si128();
+
+	for (; length - i >= 16; i += 16) {
+		const __m128i Bytes = _mm_loadu_si128((const __m128i*)(text + i));
+
+		if (_mm_movemask_epi8(Bytes) != 0) {
+			break;
+		}
+
+		const __m128i Lo = _mm_unpacklo_epi8(Bytes, Zero);
+		const __m128i Hi = _mm_unpackhi_epi8(Bytes, Zero);
+
+		_mm_storeu_si128((__m128i*)(out + i), _mm_unpacklo_epi16(Lo, Zero));
+		_mm_storeu_si128((__m128i*)(out + i + 4), _mm_unpackhi_epi16(Lo, Zero));
+		_mm_storeu_si128((__m128i*)(out + i + 8), _mm_unpacklo_epi16(Hi, Zero));
+		_mm_storeu_si128((__m128i*)(out + i + 12), _mm_unpackhi_epi16(Hi, Zero));
+	}
+#elif defined(HAS_NEON)
+	for (; length - i >= 16; i += 16) {
+		const uint8x16_t Bytes = vld1q_u8(text + i);
+
+		if (vmaxvq_u8(Bytes) >= 0x80) {
+			break;
+		}
+
+		const uint16x8_t Lo = vmovl_u8(vget_low_u8(Bytes));
+		const uint16x8_t Hi = vmovl_u8(vget_high_u8(Bytes));
+
+		vst1q_u32(out + i, vmovl_u16(vget_low_u16(Lo)));
+		vst1q_u32(out + i + 4, vmovl_u16(vget_high_u16(Lo)));
+		vst1q_u32(out + i + 8, vmovl_u16(vget_low_u16(Hi)));
+		vst1q_u32(out + i + 12, vmovl_u16(vget_high_u16(Hi)));
+	}
+#endif
+
+	return i;
+}
+
+// Widens runs of 8 UTF-16 units that contain no surrogates
+static size_t WidenBmp(const char16_t* text, size_t length, uint32_t* out) {
+	size_t i = 0;
+
+#if defined(HAS_SSE2)
+	const __m128i Zero = _mm_setzero_si128();
+	const __m128i SurrogateMask = _mm_set1_epi16((short)0xF800);
+	const __m128i Surrogate = _mm_set1_epi16((short)0xD800);
+
+	for (; length - i >= 8; i += 8) {
+		const __m128i Units = _mm_loadu_si128((const __m128i*)(text + i));
+		const __m128i IsSurrogate = _mm_cmpeq_epi16(_mm_and_si128(Units, SurrogateMask), Surrogate);
+
+		if (_mm_movemask_epi8(IsSurrogate) != 0) {
+			break;
+		}
+
+		_mm_storeu_si128((__m128i*)(out + i), _mm_unpacklo_epi16(Units, Zero));
+		_mm_storeu_si128((__m128i*)(out + i + 4), _mm_unpackhi_epi16(Units, Zero));
+	}
+#elif defined(HAS_NEON)
+	const uint16x8_t SurrogateMask = vdupq_n_u16(0xF800);
+	const uint16x8_t Surrogate = vdupq_n_u16(0xD800);
+
+	for (; length - i >= 8; i += 8) {
+		const uint16x8_t Units = vld1q_u16((const uint16_t*)(text + i));
+		const uint16x8_t IsSurrogate = vceqq_u16(vandq_u16(Units, SurrogateMask), Surrogate);
+
+		if (vmaxvq_u16(IsSurrogate) != 0) {
+			break;
+		}
+
+		vst1q_u32(out + i, vmovl_u16(vget_low_u16(Units)));
+		vst1q_u32(out + i + 4, vmovl_u16(vget_high_u16(Units)));
+	}
+#endif
+
+	return i;
+}
+
+size_t DecodeUtf8(const char* text, size_t length, uint32_t* out) {
+	const uint8_t* s = (const uint8_t*)text;
+	const uint8_t* end = s + length;
+	uint32_t* o = out;
+
+	while (s < end) {
+		const size_t Widened = WidenAscii(s, end - s, o);
+		s += Widened;
+		o += Widened;
+
+		if (s == end) {
+			break;
+		}
+
+		uint32_t c = *s;
+
+		if (c < 0x80) {
+			*o++ = c;
+			s++;
+			continue;
+		}
+
+		size_t numTrailing;
+		uint32_t min;
+
+		if ((c & 0xE0) == 0xC0) {
+			numTrailing = 1;
+			min = 0x80;
+			c &= 0x1F;
+		}
+		else if ((c & 0xF0) == 0xE0) {
+			numTrailing = 2;
+			min = 0x800;
+			c &= 0x0F;
+		}
+		else if ((c & 0xF8) == 0xF0) {
+			numTrailing = 3;
+			min = 0x10000;
+			c &= 0x07;
+		}
+		else {
+			// Stray continuation byte or an invalid lead
+			*o++ = ReplacementCharacter;
+			s++;
+			continue;
+		}
+
+		size_t i = 1;
+
+		for (; i <= numTrailing && s + i < end; i++) {
+			if ((s[i] & 0xC0) != 0x80) {
+				break;
+			}
+
+			c = (c << 6) | (s[i] & 0x3F);
+		}
+
+		// Truncated, the byte that cut it short starts the next sequence
+		if (i <= numTrailing) {
+			*o++ = ReplacementCharacter;
+			s += i;
+			continue;
+		}
+
+		// Overlong, surrogates and anything past U+10FFFF
+		if (c < min || c > 0x10FFFF || (c >= 0xD800 && c <= 0xDFFF)) {
+			c = ReplacementCharacter;
+		}
+
+		*o++ = c;
+		s += numTrailing + 1;
+	}
+
+	return o - out;
+}
+
+size_t DecodeUtf16(const char16_t* text, size_t length, uint32_t* out) {
+	const char16_t* s = text;
+	const char16_t* end = text + length;
+	uint32_t* o = out;
+
+	while (s < end) {
+		const size_t Widened = WidenBmp(s, end - s, o);
+		s += Widened;
+		o += Widened;
+
+		if (s == end) {
+			break;
+		}
+
+		const uint32_t c = *s++;
+
+		if (c < 0xD800 || c > 0xDFFF) {
+			*o++ = c;
+		}
+		else if (c <= 0xDBFF && s < end && *s >= 0xDC00 && *s <= 0xDFFF) {
+			*o++ = 0x10000 + ((c - 0xD800) << 10) + (*s++ - 0xDC00);
+		}
+		else {
+			// Unpaired surrogate
+			*o++ = ReplacementCharacter;
+		}
+	}
+
+	return o - out;
+}
+
+size_t TrimUtf8(const char* text, size_t length, size_t maxLength) {
+	if (length <= maxLength) {
+		return length;
+	}
+
+	// Back up to the lead of the sequence the cut lands in, no sequence
+	// has more than three continuation bytes
+	size_t cut = maxLength;
+
+	while (cut > 0 && maxLength - cut < 3 && ((uint8_t)text[cut] & 0xC0) == 0x80) {
+		cut--;
+	}
+
+	// Malformed, or a sequence longer than maxLength, is cut where asked
+	if (cut == 0 || ((uint8_t)text[cut] & 0xC0) == 0x80) {
+		return maxLength;
+	}
+
+	return cut;
+}
+
+size_t DecodeUtf32(const char32_t* text, size_t length, uint32_t* out) {
+	for (size_t i = 0; i < length; i++) {
+		const uint32_t c = text[i];
+
+		out[i] = (c > 0x10FFFF || (c >= 0xD800 && c <= 0xDFFF)) ? ReplacementCharacter : c;
+	}
+
+	return length;
+}
+
+}
@@ -1,5 +1,18 @@
 #include "Utility.hpp"
 
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#define HAS_MMAP 1
+#elif defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#define HAS_MAP_VIEW 1
+#endif
+
 namespace Utility {
 void LoadFile(const char* path, std::vector<uint8_t>& buffer) {
 	std::ifstream file(path, std::ios::binary);
@@ -15,4 +28,109 @@ void LoadFile(const char* path, std::vector<uint8_t>& buffer) {
 	buffer.resize(size);
 	file.read((char*)buffer.data(), buffer.size());
 }
+
+bool MapFile(const char* path, MappedFile& file) {
+	UnmapFile(file);
+
+#if HAS_MMAP
+	int fd = open(path, O_RDONLY);
+
+	if (fd < 0) {
+		return false;
+	}
+
+	struct stat st;
+
+	if (fstat(fd, &st) != 0) {
+		close(fd);
+		return false;
+	}
+
+	file.size = (size_t)st.st_size;
+
+	// Empty files can't be mapped but are still valid
+	if (file.size > 0) {
+		void* data = mmap(nullptr, file.size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+		if (data == MAP_FAILED) {
+			close(fd);
+			file.size = 0;
+			return false;
+		}
+
+		file.data = (const uint8_t*)data;
+		file.mapped = true;
+	}
+
+	// The mapping stays valid after the descriptor is closed
+	close(fd);
+	return true;
+#elif HAS_MAP_VIEW
+	HANDLE handle = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+
+	if (handle == INVALID_HANDLE_VALUE) {
+		return false;
+	}
+
+	LARGE_INTEGER size;
+
+	if (!GetFileSizeEx(handle, &size)) {
+		CloseHandle(handle);
+		return false;
+	}
+
+	file.size = (size_t)size.QuadPart;
+
+	// Empty files can't be mapped but are still valid
+	if (file.size > 0) {
+		HANDLE mapping = CreateFileMappingA(handle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		void* data = mapping ? MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+
+		if (mapping) {
+			CloseHandle(mapping);
+		}
+
+		if (!data) {
+			CloseHandle(handle);
+			file.size = 0;
+			return false;
+		}
+
+		file.data = (const uint8_t*)data;
+		file.mapped = true;
+	}
+
+	// The view keeps the mapping and the file open until it's unmapped
+	CloseHandle(handle);
+	return true;
+#else
+	std::ifstream stream(path, std::ios::binary);
+
+	if (!stream) {
+		return false;
+	}
+
+	LoadFile(path, file.fallback);
+	file.data = file.fallback.data();
+	file.size = file.fallback.size();
+	return true;
+#endif
+}
+
+void UnmapFile(MappedFile& file) {
+#if HAS_MMAP
+	if (file.mapped) {
+		munmap((void*)file.data, file.size);
+	}
+#elif HAS_MAP_VIEW
+	if (file.mapped) {
+		UnmapViewOfFile(file.data);
+	}
+#endif
+
+	file.data = nullptr;
+	file.size = 0;
+	file.mapped = false;
+	file.fallback.clear();
+}
 }
\ No newline at end of file